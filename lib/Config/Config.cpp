@@ -23,6 +23,19 @@ bool Config::readConfig() {
     MqttPassword.setValue(preferences.getString("MqttPassword", ""));
     SpaName.setValue(preferences.getString("SpaName", "eSpa"));
     UpdateFrequency.setValue(preferences.getInt("spaPollFreq", 60));
+    StatisticsWindow.setValue(preferences.getInt("statsWindow", 10));
+    StatisticsSensors.setValue(preferences.getBool("statsSensors", false));
+    MqttDeltaStatus.setValue(preferences.getBool("mqttDelta", false));
+    MqttFullStatusInterval.setValue(preferences.getInt("mqttFullIntvl", 10));
+    MqttPropertyTopics.setValue(preferences.getBool("mqttPropTopics", false));
+    MqttMsgPackStatus.setValue(preferences.getBool("mqttMsgPack", false));
+    InfluxHost.setValue(preferences.getString("InfluxHost", ""));
+    InfluxPort.setValue(preferences.getInt("InfluxPort", 8089));
+    InfluxChangedOnly.setValue(preferences.getBool("InfluxChanged", false));
+    PublishMinInterval.setValue(preferences.getInt("PubMinInterval", 0));
+    PublishHeartbeat.setValue(preferences.getInt("PubHeartbeat", 0));
+    MqttAbbreviateDiscovery.setValue(preferences.getBool("mqttAbbrevAD", false));
+    MqttDeviceDiscovery.setValue(preferences.getBool("mqttDeviceAD", false));
 
     preferences.end();
     return true;
@@ -46,12 +59,47 @@ void Config::writeConfig() {
     preferences.putString("MqttPassword", MqttPassword.getValue());
     preferences.putString("SpaName", SpaName.getValue());
     preferences.putInt("spaPollFreq", UpdateFrequency.getValue());
+    preferences.putInt("statsWindow", StatisticsWindow.getValue());
+    preferences.putBool("statsSensors", StatisticsSensors.getValue());
+    preferences.putBool("mqttDelta", MqttDeltaStatus.getValue());
+    preferences.putInt("mqttFullIntvl", MqttFullStatusInterval.getValue());
+    preferences.putBool("mqttPropTopics", MqttPropertyTopics.getValue());
+    preferences.putBool("mqttMsgPack", MqttMsgPackStatus.getValue());
+    preferences.putString("InfluxHost", InfluxHost.getValue());
+    preferences.putInt("InfluxPort", InfluxPort.getValue());
+    preferences.putBool("InfluxChanged", InfluxChangedOnly.getValue());
+    preferences.putInt("PubMinInterval", PublishMinInterval.getValue());
+    preferences.putInt("PubHeartbeat", PublishHeartbeat.getValue());
+    preferences.putBool("mqttAbbrevAD", MqttAbbreviateDiscovery.getValue());
+    preferences.putBool("mqttDeviceAD", MqttDeviceDiscovery.getValue());
     preferences.end();
   } else {
     debugE("Failed to open Preferences for writing");
   }
 }
 
+bool Config::readDiscoveryState(uint32_t &session, String &slots, std::vector<uint32_t> &hashes) {
+  if (!preferences.begin("eSpa-discovery", true)) return false;
+  size_t length = preferences.getBytesLength("hashes");
+  hashes.resize(length / sizeof(uint32_t));
+  bool valid = length > 0 && preferences.getBytes("hashes", hashes.data(), length) == length;
+  session = preferences.getUInt("session", 0);
+  slots = preferences.getString("slots", "");
+  preferences.end();
+  return valid && session != 0 && slots.length() > 0;
+}
+
+void Config::writeDiscoveryState(uint32_t session, const String &slots, const uint32_t *hashes, size_t count) {
+  if (preferences.begin("eSpa-discovery", false)) {
+    preferences.putUInt("session", session);
+    preferences.putString("slots", slots);
+    preferences.putBytes("hashes", hashes, count * sizeof(uint32_t));
+    preferences.end();
+  } else {
+    debugE("Failed to open Preferences for writing discovery hashes");
+  }
+}
+
 // Read config from file and populate settings
 bool Config::readConfigFile() {
   debugI("Reading config file");
@@ -82,6 +130,19 @@ bool Config::readConfigFile() {
       if (json["mqtt_password"].is<String>()) MqttPassword.setValue(json["mqtt_password"].as<String>());
       if (json["spa_name"].is<String>()) SpaName.setValue(json["spa_name"].as<String>());
       if (json["update_frequency"].is<int>()) UpdateFrequency.setValue(json["update_frequency"].as<int>());
+      if (json["statistics_window"].is<int>()) StatisticsWindow.setValue(json["statistics_window"].as<int>());
+      if (json["statistics_sensors"].is<bool>()) StatisticsSensors.setValue(json["statistics_sensors"].as<bool>());
+      if (json["mqtt_delta_status"].is<bool>()) MqttDeltaStatus.setValue(json["mqtt_delta_status"].as<bool>());
+      if (json["mqtt_full_status_interval"].is<int>()) MqttFullStatusInterval.setValue(json["mqtt_full_status_interval"].as<int>());
+      if (json["mqtt_property_topics"].is<bool>()) MqttPropertyTopics.setValue(json["mqtt_property_topics"].as<bool>());
+      if (json["mqtt_msgpack_status"].is<bool>()) MqttMsgPackStatus.setValue(json["mqtt_msgpack_status"].as<bool>());
+      if (json["influx_host"].is<String>()) InfluxHost.setValue(json["influx_host"].as<String>());
+      if (json["influx_port"].is<int>()) InfluxPort.setValue(json["influx_port"].as<int>());
+      if (json["influx_changed_only"].is<bool>()) InfluxChangedOnly.setValue(json["influx_changed_only"].as<bool>());
+      if (json["publish_min_interval"].is<int>()) PublishMinInterval.setValue(json["publish_min_interval"].as<int>());
+      if (json["publish_heartbeat"].is<int>()) PublishHeartbeat.setValue(json["publish_heartbeat"].as<int>());
+      if (json["mqtt_abbreviate_discovery"].is<bool>()) MqttAbbreviateDiscovery.setValue(json["mqtt_abbreviate_discovery"].as<bool>());
+      if (json["mqtt_device_discovery"].is<bool>()) MqttDeviceDiscovery.setValue(json["mqtt_device_discovery"].as<bool>());
     } else {
       debugW("Failed to parse config file");
       LittleFS.end();
@@ -110,6 +171,19 @@ void Config::writeConfigFile() {
   json["mqtt_password"] = MqttPassword.getValue();
   json["spa_name"] = SpaName.getValue();
   json["update_frequency"] = UpdateFrequency.getValue();
+  json["statistics_window"] = StatisticsWindow.getValue();
+  json["statistics_sensors"] = StatisticsSensors.getValue();
+  json["mqtt_delta_status"] = MqttDeltaStatus.getValue();
+  json["mqtt_full_status_interval"] = MqttFullStatusInterval.getValue();
+  json["mqtt_property_topics"] = MqttPropertyTopics.getValue();
+  json["mqtt_msgpack_status"] = MqttMsgPackStatus.getValue();
+  json["influx_host"] = InfluxHost.getValue();
+  json["influx_port"] = InfluxPort.getValue();
+  json["influx_changed_only"] = InfluxChangedOnly.getValue();
+  json["publish_min_interval"] = PublishMinInterval.getValue();
+  json["publish_heartbeat"] = PublishHeartbeat.getValue();
+  json["mqtt_abbreviate_discovery"] = MqttAbbreviateDiscovery.getValue();
+  json["mqtt_device_discovery"] = MqttDeviceDiscovery.getValue();
 
   File configFile = LittleFS.open("/config.json", "w");
   if (!configFile) {
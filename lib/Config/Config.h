@@ -6,6 +6,7 @@
 #include <ArduinoJson.h>
 #include <RemoteDebug.h>
 #include <LittleFS.h>
+#include <vector>
 
 extern RemoteDebug Debug;
 
@@ -71,6 +72,19 @@ public:
     Setting<String> MqttPassword = Setting<String>("MqttPassword");
     Setting<String> SpaName = Setting<String>("SpaName", "eSpa");
     Setting<int> UpdateFrequency = Setting<int>("UpdateFrequency", 60, 10, 300);
+    Setting<int> StatisticsWindow = Setting<int>("StatisticsWindow", 10, 2, 60);
+    Setting<bool> StatisticsSensors = Setting<bool>("StatisticsSensors", false);
+    Setting<bool> MqttDeltaStatus = Setting<bool>("MqttDeltaStatus", false);
+    Setting<int> MqttFullStatusInterval = Setting<int>("MqttFullStatusInterval", 10, 1, 1440);
+    Setting<bool> MqttPropertyTopics = Setting<bool>("MqttPropertyTopics", false);
+    Setting<bool> MqttMsgPackStatus = Setting<bool>("MqttMsgPackStatus", false);
+    Setting<String> InfluxHost = Setting<String>("InfluxHost");
+    Setting<int> InfluxPort = Setting<int>("InfluxPort", 8089, 1, 65535);
+    Setting<bool> InfluxChangedOnly = Setting<bool>("InfluxChangedOnly", false);
+    Setting<int> PublishMinInterval = Setting<int>("PublishMinInterval", 0, 0, 3600);
+    Setting<int> PublishHeartbeat = Setting<int>("PublishHeartbeat", 0, 0, 3600);
+    Setting<bool> MqttAbbreviateDiscovery = Setting<bool>("MqttAbbreviateDiscovery", false);
+    Setting<bool> MqttDeviceDiscovery = Setting<bool>("MqttDeviceDiscovery", false);
 };
 
 class Config : public ControllerConfig {
@@ -81,6 +95,14 @@ public:
     bool readConfig();              // Read configuration from Preferences or file
     void writeConfig();             // Write configuration to Preferences
 
+    /// @brief Read what the last Home Assistant discovery run published.
+    /// @param session Id of the run, also retained on the broker so a broker that lost it is noticed
+    /// @param slots Ids of the discovery rows the hashes belong to, one per line
+    /// @param hashes Hash of each published payload, one per row plus the device config
+    /// @return False if nothing (or a state from an older firmware) is stored
+    bool readDiscoveryState(uint32_t &session, String &slots, std::vector<uint32_t> &hashes);
+    void writeDiscoveryState(uint32_t session, const String &slots, const uint32_t *hashes, size_t count);
+
     // Set callback for all Setting instances
     template <typename T>
     void setCallback(void (*callback)(const char*, T)) {
@@ -0,0 +1,118 @@
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// @brief 10^n, usable in constant expressions.
+constexpr int32_t pow10i(uint8_t n) { return n == 0 ? 1 : 10 * pow10i(n - 1); }
+
+/// @brief Decimal fixed point number stored as an integer scaled by 10^Decimals.
+///
+/// The controller reports many readings this way (eg WTMP 385 = 38.5'C).  Keeping them as
+/// integers means comparisons, parsing and printing are exact and never touch the FPU.
+template <uint8_t Decimals>
+class FixedPoint
+{
+public:
+    static constexpr int32_t scale = pow10i(Decimals);
+    /// @brief Buffer size needed by toChars (sign, 10 digits, point and terminator).
+    static const size_t maxChars = 13;
+
+    constexpr FixedPoint() : _raw(0) {}
+
+    /// @brief Value from the controller's scaled integer (eg fromRaw(385) is 38.5 for Decimals = 1).
+    static constexpr FixedPoint fromRaw(int32_t raw) { return FixedPoint(raw); }
+    constexpr int32_t raw() const { return _raw; }
+
+    float toFloat() const { return (float)_raw / scale; }
+
+    /// @brief Parse a decimal string ("38", "38.5", "-0.25").  Extra decimals are rounded half away from zero.
+    /// @return False if s is not a number in range, value is left unchanged.
+    static bool parse(const char *s, FixedPoint &value) { return parse(s, strlen(s), value); }
+    /// @brief As parse, for characters that are not NUL terminated (eg an MQTT payload).
+    static bool parse(const char *s, size_t length, FixedPoint &value);
+
+    /// @brief Print with exactly Decimals decimal places.
+    /// @return Number of characters written, excluding the terminator.
+    size_t toChars(char *buffer, size_t size) const;
+
+    bool operator==(const FixedPoint &other) const { return _raw == other._raw; }
+    bool operator!=(const FixedPoint &other) const { return _raw != other._raw; }
+    bool operator<(const FixedPoint &other) const { return _raw < other._raw; }
+    bool operator>(const FixedPoint &other) const { return _raw > other._raw; }
+
+private:
+    constexpr explicit FixedPoint(int32_t raw) : _raw(raw) {}
+    int32_t _raw;
+};
+
+template <uint8_t Decimals>
+constexpr int32_t FixedPoint<Decimals>::scale;
+
+template <uint8_t Decimals>
+bool FixedPoint<Decimals>::parse(const char *s, size_t length, FixedPoint &value)
+{
+    const char *end = s + length;
+    while (s < end && isspace(*s)) s++;
+
+    bool negative = (s < end && *s == '-');
+    if (s < end && (*s == '-' || *s == '+')) s++;
+
+    int64_t raw = 0;
+    bool digits = false;
+    while (s < end && isdigit(*s)) {
+        raw = raw * 10 + (*s++ - '0');
+        if (raw > INT32_MAX) return false;
+        digits = true;
+    }
+
+    uint8_t decimals = 0;
+    if (s < end && *s == '.') {
+        s++;
+        while (s < end && isdigit(*s)) {
+            if (decimals < Decimals) raw = raw * 10 + (*s - '0');
+            else if (decimals == Decimals && *s >= '5') raw++;
+            if (decimals <= Decimals) decimals++;
+            s++;
+            digits = true;
+        }
+    }
+
+    while (s < end && isspace(*s)) s++;
+    if (!digits || s != end) return false;
+
+    for (; decimals < Decimals; decimals++) raw *= 10;
+    if (raw > INT32_MAX) return false;
+
+    value._raw = negative ? -raw : raw;
+    return true;
+}
+
+template <uint8_t Decimals>
+size_t FixedPoint<Decimals>::toChars(char *buffer, size_t size) const
+{
+    if (size == 0) return 0;
+
+    // Digits least significant first, padded so 5 prints as 0.5 rather than .5
+    uint32_t magnitude = _raw < 0 ? -(uint32_t)_raw : _raw;
+    char digits[maxChars];
+    size_t count = 0;
+    do {
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0 || count <= Decimals);
+
+    size_t len = 0;
+    if (_raw < 0 && len + 1 < size) buffer[len++] = '-';
+    while (count > 0 && len + 1 < size) {
+        buffer[len++] = digits[--count];
+        if (Decimals > 0 && count == Decimals && len + 1 < size) buffer[len++] = '.';
+    }
+    buffer[len] = '\0';
+    return len;
+}
+
+#endif // FIXEDPOINT_H
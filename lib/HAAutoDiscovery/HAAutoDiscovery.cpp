@@ -1,10 +1,120 @@
 #include "HAAutoDiscovery.h"
 
+// https://www.home-assistant.io/integrations/mqtt/#using-abbreviations-in-mqtt-discovery-messages
+// Keys not listed are written in full.
+static constexpr const char* abbreviations[][2] = {
+   {"action_template", "act_tpl"},
+   {"action_topic", "act_t"},
+   {"availability_topic", "avty_t"},
+   {"brightness_command_topic", "bri_cmd_t"},
+   {"brightness_scale", "bri_scl"},
+   {"brightness_state_topic", "bri_stat_t"},
+   {"brightness_value_template", "bri_val_tpl"},
+   {"components", "cmps"},
+   {"color_mode_state_topic", "clrm_stat_t"},
+   {"color_mode_value_template", "clrm_val_tpl"},
+   {"command_topic", "cmd_t"},
+   {"configuration_url", "cu"},
+   {"current_temperature_template", "curr_temp_tpl"},
+   {"current_temperature_topic", "curr_temp_t"},
+   {"device", "dev"},
+   {"device_class", "dev_cla"},
+   {"effect_command_topic", "fx_cmd_t"},
+   {"effect_list", "fx_list"},
+   {"effect_state_topic", "fx_stat_t"},
+   {"effect_value_template", "fx_val_tpl"},
+   {"entity_category", "ent_cat"},
+   {"hs_command_topic", "hs_cmd_t"},
+   {"hs_state_topic", "hs_stat_t"},
+   {"hs_value_template", "hs_val_tpl"},
+   {"icon", "ic"},
+   {"identifiers", "ids"},
+   {"initial", "init"},
+   {"manufacturer", "mf"},
+   {"mode_state_template", "mode_stat_tpl"},
+   {"mode_state_topic", "mode_stat_t"},
+   {"model", "mdl"},
+   {"options", "ops"},
+   {"origin", "o"},
+   {"percentage_command_topic", "pct_cmd_t"},
+   {"percentage_state_topic", "pct_stat_t"},
+   {"percentage_value_template", "pct_val_tpl"},
+   {"platform", "p"},
+   {"preset_mode_command_topic", "pr_mode_cmd_t"},
+   {"preset_mode_state_topic", "pr_mode_stat_t"},
+   {"preset_mode_value_template", "pr_mode_val_tpl"},
+   {"preset_modes", "pr_modes"},
+   {"serial_number", "sn"},
+   {"speed_range_max", "spd_rng_max"},
+   {"speed_range_min", "spd_rng_min"},
+   {"state_class", "stat_cla"},
+   {"state_topic", "stat_t"},
+   {"state_value_template", "stat_val_tpl"},
+   {"support_url", "url"},
+   {"supported_color_modes", "sup_clrm"},
+   {"sw_version", "sw"},
+   {"temperature_command_topic", "temp_cmd_t"},
+   {"temperature_state_template", "temp_stat_tpl"},
+   {"temperature_state_topic", "temp_stat_t"},
+   {"temperature_unit", "temp_unit"},
+   {"unique_id", "uniq_id"},
+   {"unit_of_measurement", "unit_of_meas"},
+   {"value_template", "val_tpl"},
+};
+
+static const char* abbreviateKey(const char* key) {
+   for (const auto& abbreviation : abbreviations) {
+      if (strcmp(abbreviation[0], key) == 0) return abbreviation[1];
+   }
+   return key;
+}
+
+/// @brief Replace the base topic at the start of a topic with ~.
+static String compactTopic(const char* topic, const String& baseTopic) {
+   size_t length = baseTopic.length();
+   if (length > 0 && strncmp(topic, baseTopic.c_str(), length) == 0 && topic[length] == '/') {
+      return String("~") + (topic + length);
+   }
+   return topic;
+}
+
+static void abbreviateObject(JsonObjectConst source, JsonObject target, const String& baseTopic) {
+   for (JsonPairConst member : source) {
+      const char* key = member.key().c_str();
+      JsonVariantConst value = member.value();
+
+      if (strcmp(key, "availability") == 0 && value["topic"].is<const char*>()) {
+         // Single availability topic, the short form of the availability list
+         target["avty_t"] = compactTopic(value["topic"].as<const char*>(), baseTopic);
+      } else if (strcmp(key, "components") == 0 && value.is<JsonObjectConst>()) {
+         // Device discovery, the members are object ids rather than keys
+         JsonObject components = target[abbreviateKey(key)].to<JsonObject>();
+         for (JsonPairConst component : value.as<JsonObjectConst>()) {
+            abbreviateObject(component.value().as<JsonObjectConst>(), components[component.key()].to<JsonObject>(), baseTopic);
+         }
+      } else if (value.is<JsonObjectConst>()) {
+         abbreviateObject(value.as<JsonObjectConst>(), target[abbreviateKey(key)].to<JsonObject>(), baseTopic);
+      } else if (value.is<const char*>() && strlen(key) > 6 && strcmp(key + strlen(key) - 6, "_topic") == 0) {
+         target[abbreviateKey(key)] = compactTopic(value.as<const char*>(), baseTopic);
+      } else {
+         target[abbreviateKey(key)] = value;
+      }
+   }
+}
+
+const JsonDocument& compactAdJSON(const JsonDocument& json, const SpaADInformationTemplate& spa, JsonDocument& compact) {
+   if (!spa.abbreviate) return json;
+
+   JsonObject root = compact.to<JsonObject>();
+   if (spa.baseTopic.length() > 0) root["~"] = spa.baseTopic;
+   abbreviateObject(json.as<JsonObjectConst>(), root, spa.baseTopic);
+   return compact;
+}
+
 void generateCommonAdJSON(
    JsonDocument& json,
    const AutoDiscoveryInformationTemplate& config,
    const SpaADInformationTemplate& spa,
-   String& discoveryTopic,
    String type
    ) {
 /*
@@ -38,50 +148,103 @@ void generateCommonAdJSON(
    json["availability"]["topic"] = spa.availabilityTopic;
    if (!config.deviceClass.isEmpty()) json["device_class"] = config.deviceClass;
    if (!config.entityCategory.isEmpty()) json["entity_category"] = config.entityCategory;
+}
 
-   discoveryTopic = "homeassistant/" + type + "/" + spa.spaSerialNumber + "/" + spa.spaSerialNumber + "-" + config.propertyId + "/config";
+const char* adComponentName(AdComponent component) {
+   switch (component) {
+      case AdComponent::Sensor: return "sensor";
+      case AdComponent::BinarySensor: return "binary_sensor";
+      case AdComponent::Climate: return "climate";
+      case AdComponent::Fan: return "fan";
+      case AdComponent::Light: return "light";
+      case AdComponent::Select: return "select";
+      case AdComponent::Switch: return "switch";
+      case AdComponent::Text: return "text";
+   }
+   return "";
+}
+
+size_t adDiscoveryTopic(char* topic, size_t size, const SpaADInformationTemplate& spa, const char* type, const char* propertyId) {
+   int length = snprintf(topic, size, "homeassistant/%s/%s/%s-%s/config",
+      type, spa.spaSerialNumber.c_str(), spa.spaSerialNumber.c_str(), propertyId);
+   return length < 0 ? 0 : min((size_t)length, size - 1);
+}
 
+size_t adDeviceDiscoveryTopic(char* topic, size_t size, const SpaADInformationTemplate& spa) {
+   int length = snprintf(topic, size, "homeassistant/device/%s/config", spa.spaSerialNumber.c_str());
+   return length < 0 ? 0 : min((size_t)length, size - 1);
 }
 
-void generateSensorAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic, String stateClass, String unitOfMeasure) {
-   JsonDocument json;
-   generateCommonAdJSON(json, config, spa, discoveryTopic, "sensor");
+void generateSensorAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String stateClass, String unitOfMeasure) {
+   generateCommonAdJSON(json, config, spa, "sensor");
 
    if (!unitOfMeasure.isEmpty()) json["unit_of_measurement"] = unitOfMeasure;
    if (!stateClass.isEmpty()) json["state_class"] = stateClass;
+}
 
-   serializeJson(json, output);
+void generateBinarySensorAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa) {
+   generateCommonAdJSON(json, config, spa, "binary_sensor");
 }
 
-void generateBinarySensorAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic) {
-   JsonDocument json;
-   generateCommonAdJSON(json, config, spa, discoveryTopic, "binary_sensor");
+void generateTextAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String regex) {
+   generateCommonAdJSON(json, config, spa, "text");
 
-   serializeJson(json, output);
+   json["command_topic"] = spa.commandTopic + "/" + config.propertyId;
+   if (!regex.isEmpty()) json["pattern"] = regex;
 }
 
-void generateTextAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic, String regex) {
-   JsonDocument json;
-   generateCommonAdJSON(json, config, spa, discoveryTopic, "text");
+void generateSelectAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, const char* const* options, size_t optionsSize) {
+   generateCommonAdJSON(json, config, spa, "select");
 
    json["command_topic"] = spa.commandTopic + "/" + config.propertyId;
-   if (!regex.isEmpty()) json["pattern"] = regex;
+   JsonArray opts = json["options"].to<JsonArray>();
+   for (size_t i = 0; i < optionsSize; ++i) opts.add(options[i]);
+}
+
+void generateLightAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, const char* const* colorModes, size_t colorModesSize) {
+   generateCommonAdJSON(json, config, spa, "light");
+
+   json["brightness_state_topic"] = spa.stateTopic;
+   json["color_mode_state_topic"] = spa.stateTopic;
+   json["effect_state_topic"] = spa.stateTopic;
+   json["hs_state_topic"] = spa.stateTopic;
 
-   serializeJson(json, output);
+   json["command_topic"] = spa.commandTopic + "/" + config.propertyId + "_state";
+   json["brightness_command_topic"] = spa.commandTopic + "/" + config.propertyId + "_brightness";
+   json["effect_command_topic"] = spa.commandTopic + "/" + config.propertyId + "_effect";
+   json["hs_command_topic"] = spa.commandTopic + "/" + config.propertyId + "_color";
+
+   // Find the last character that is not a space or curly brace
+   int lastIndex = config.valueTemplate.length() - 1;
+   while (lastIndex >= 0 && (config.valueTemplate[lastIndex] == ' ' || config.valueTemplate[lastIndex] == '}')) {
+      lastIndex--;
+   }
+
+   // Value templates to extract values from the same topic
+   json["state_value_template"] = config.valueTemplate.substring(0, lastIndex + 1) + ".state" + config.valueTemplate.substring(lastIndex + 1);
+   json["brightness_value_template"] = config.valueTemplate.substring(0, lastIndex + 1) + ".brightness" + config.valueTemplate.substring(lastIndex + 1);
+   json["effect_value_template"] = config.valueTemplate.substring(0, lastIndex + 1) + ".effect" + config.valueTemplate.substring(lastIndex + 1);
+   json["hs_value_template"] = config.valueTemplate.substring(0, lastIndex + 1) + ".color.h" + config.valueTemplate.substring(lastIndex + 1) + ","
+                              + config.valueTemplate.substring(0, lastIndex + 1) + ".color.s" + config.valueTemplate.substring(lastIndex + 1);
+   json["color_mode_value_template"] = config.valueTemplate.substring(0, lastIndex + 1) + ".color_mode" + config.valueTemplate.substring(lastIndex + 1);
+
+   json["brightness"] = true;
+   json["brightness_scale"]=5;
+   json["effect"] = true;
+   JsonArray effect_list = json["effect_list"].to<JsonArray>();
+   for (size_t i = 0; i < colorModesSize; ++i) effect_list.add(colorModes[i]);
+   JsonArray color_modes = json["supported_color_modes"].to<JsonArray>();
+   color_modes.add("hs");
 }
 
-void generateSwitchAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic) {
-   JsonDocument json;
-   generateCommonAdJSON(json, config, spa, discoveryTopic, "switch");
+void generateSwitchAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa) {
+   generateCommonAdJSON(json, config, spa, "switch");
 
    json["command_topic"] = spa.commandTopic + "/" + config.propertyId;
-
-   serializeJson(json, output);
 }
 
-void generateFanAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic, int min, int max, const String* modes, const size_t modesSize) {
-   JsonDocument json;
-   generateCommonAdJSON(json, config, spa, discoveryTopic, "fan");
+void generateFanAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, int min, int max, const char* const* modes, const size_t modesSize) {
+   generateCommonAdJSON(json, config, spa, "fan");
 
    // Find the last character that is not a space or curly brace
    int lastIndex = config.valueTemplate.length() - 1;
@@ -113,13 +276,10 @@ void generateFanAdJSON(String& output, const AutoDiscoveryInformationTemplate& c
     if (config.propertyId.startsWith("pump")) {
       json["icon"] = "mdi:pump";
    }
-
-   serializeJson(json, output);
 }
 
-void generateClimateAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic) {
-   JsonDocument json;
-   generateCommonAdJSON(json, config, spa, discoveryTopic, "climate");
+void generateClimateAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa) {
+   generateCommonAdJSON(json, config, spa, "climate");
 
    // Find the last character that is not a space or curly brace
    int lastIndex = config.valueTemplate.length() - 1;
@@ -146,6 +306,70 @@ void generateClimateAdJSON(String& output, const AutoDiscoveryInformationTemplat
    json["temperature_state_topic"] = spa.stateTopic;
    json["temperature_unit"]="C";
    json["temp_step"]=0.2;
+}
+
+void generateEntityAdJSON(JsonDocument& json, const AutoDiscoveryEntity& entity, const SpaADInformationTemplate& spa, const AutoDiscoveryRuntime& runtime) {
+   AutoDiscoveryInformationTemplate config;
+   config.displayName = entity.displayName;
+   config.valueTemplate = entity.valueTemplate;
+   config.propertyId = entity.propertyId;
+   config.deviceClass = entity.deviceClass;
+   config.entityCategory = entity.entityCategory;
+
+   switch (entity.component) {
+      case AdComponent::Sensor:
+         generateSensorAdJSON(json, config, spa, entity.stateClass, entity.unit);
+         break;
+      case AdComponent::BinarySensor:
+         generateBinarySensorAdJSON(json, config, spa);
+         break;
+      case AdComponent::Climate:
+         generateClimateAdJSON(json, config, spa);
+         break;
+      case AdComponent::Fan:
+         generateFanAdJSON(json, config, spa, runtime.min, runtime.max, runtime.options, runtime.optionCount);
+         break;
+      case AdComponent::Light:
+         generateLightAdJSON(json, config, spa, runtime.options, runtime.optionCount);
+         break;
+      case AdComponent::Select:
+         generateSelectAdJSON(json, config, spa, runtime.options, runtime.optionCount);
+         break;
+      case AdComponent::Switch:
+         generateSwitchAdJSON(json, config, spa);
+         break;
+      case AdComponent::Text:
+         generateTextAdJSON(json, config, spa, entity.pattern);
+         break;
+   }
+}
+
+void generateDeviceAdJSON(JsonDocument& json, const SpaADInformationTemplate& spa) {
+   json["device"]["identifiers"][0] = spa.spaSerialNumber;
+   json["device"]["serial_number"] = spa.spaSerialNumber;
+   json["device"]["name"] = spa.spaName;
+   json["device"]["manufacturer"] = spa.manufacturer;
+   json["device"]["model"] = spa.model;
+   json["device"]["sw_version"] = spa.sw_version;
+   json["device"]["configuration_url"] = spa.configuration_url;
+   json["origin"]["name"] = spa.manufacturer;
+   json["origin"]["sw_version"] = spa.sw_version;
+   json["origin"]["support_url"] = "https://github.com/wayne-love/sn_esp32";
+   json["availability"]["topic"] = spa.availabilityTopic;
+   json["state_topic"] = spa.stateTopic;
+   json["components"].to<JsonObject>();
+}
+
+void addDeviceComponentAdJSON(JsonDocument& device, JsonDocument& entity, AdComponent component, const SpaADInformationTemplate& spa) {
+   // Shared at the device level
+   entity.remove("device");
+   entity.remove("availability");
+   if (entity["state_topic"].as<String>() == spa.stateTopic) entity.remove("state_topic");
+
+   entity["platform"] = adComponentName(component);
+   device["components"][entity["unique_id"].as<String>()] = entity;
+}
 
-   serializeJson(json, output);
+void removeDeviceComponentAdJSON(JsonDocument& device, AdComponent component, const char* propertyId, const SpaADInformationTemplate& spa) {
+   device["components"][spa.spaSerialNumber + "-" + propertyId]["platform"] = adComponentName(component);
 }
@@ -4,6 +4,10 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 
+// Discovery topic buffer, fits "homeassistant/binary_sensor/<serial>/<serial>-<propertyId>/config".
+#ifndef AD_TOPIC_SIZE
+  #define AD_TOPIC_SIZE 128
+#endif
 
 /// @brief Configuration structure for the data elements for the Spa.
 struct SpaADInformationTemplate {
@@ -16,6 +20,8 @@ struct SpaADInformationTemplate {
     String model;               // MQTT topic for device model.
     String sw_version;             // MQTT topic for device software version.
     String configuration_url;   // MQTT topic for config url.
+    String baseTopic;           // Topic prefix shared by the state / command / availability topics (no trailing /)
+    bool abbreviate = false;    // Use HA's abbreviated keys and ~ for baseTopic to shrink the payloads
 };
 
 /// @brief Base configuration structure for common data elements
@@ -27,74 +33,136 @@ struct AutoDiscoveryInformationTemplate {
     String entityCategory;      // https://developers.home-assistant.io/blog/2021/10/26/config-entity?_highlight=diagnostic#entity-categories (empty string accepted)
 };
 
+/// @brief Home Assistant entity types (the discovery topic component).
+enum class AdComponent : uint8_t { Sensor, BinarySensor, Climate, Fan, Light, Select, Switch, Text };
+
+/// @brief Option lists an entity can refer to, resolved to the strings by the caller.
+enum class AdOptions : uint8_t { None, SpaMode, HeatPumpMode, LightEffect, LightSpeed, SleepTimer, Blower, PumpMode };
+
+/// @brief When an entity is published.
+enum class AdPresence : uint8_t {
+    Always,
+    Statistics,     // Statistics sensors are enabled, otherwise the entity is removed
+    HeatPump,       // A heat pump is fitted
+    Pump            // Pump AutoDiscoveryEntity::index is installed and has more than one state
+};
+
+/// @brief One row of the auto discovery table.
+///
+/// Plain constant data so a whole table can be constexpr and live in flash,
+/// build rows with the adSensor, adSelect, ... helpers below.
+struct AutoDiscoveryEntity {
+    AdComponent component;
+    const char *displayName;
+    const char *valueTemplate;
+    const char *propertyId;
+    const char *deviceClass;    // "" for none
+    const char *entityCategory; // "", "config" or "diagnostic"
+    const char *stateClass;     // Sensor only
+    const char *unit;           // Sensor only
+    const char *pattern;        // Text only, regex the value must match
+    AdOptions options;          // Select options, Fan preset modes, Light effects
+    uint8_t min;                // Fan speed range, ignored if max <= min
+    uint8_t max;
+    AdPresence presence;
+    uint8_t index;              // Pump number for AdPresence::Pump
+};
+
+constexpr AutoDiscoveryEntity adSensor(const char *name, const char *valueTemplate, const char *id, const char *deviceClass, const char *category,
+                                       const char *stateClass = "", const char *unit = "", AdPresence presence = AdPresence::Always) {
+    return AutoDiscoveryEntity{AdComponent::Sensor, name, valueTemplate, id, deviceClass, category, stateClass, unit, "", AdOptions::None, 0, 0, presence, 0};
+}
+
+constexpr AutoDiscoveryEntity adEntity(AdComponent component, const char *name, const char *valueTemplate, const char *id,
+                                       const char *deviceClass = "", const char *category = "", AdPresence presence = AdPresence::Always) {
+    return AutoDiscoveryEntity{component, name, valueTemplate, id, deviceClass, category, "", "", "", AdOptions::None, 0, 0, presence, 0};
+}
+
+constexpr AutoDiscoveryEntity adSelect(const char *name, const char *valueTemplate, const char *id, AdOptions options,
+                                       const char *category = "", AdPresence presence = AdPresence::Always) {
+    return AutoDiscoveryEntity{AdComponent::Select, name, valueTemplate, id, "", category, "", "", "", options, 0, 0, presence, 0};
+}
+
+constexpr AutoDiscoveryEntity adText(const char *name, const char *valueTemplate, const char *id, const char *pattern, const char *category = "config") {
+    return AutoDiscoveryEntity{AdComponent::Text, name, valueTemplate, id, "", category, "", "", pattern, AdOptions::None, 0, 0, AdPresence::Always, 0};
+}
+
+constexpr AutoDiscoveryEntity adFan(const char *name, const char *valueTemplate, const char *id, AdOptions presets, uint8_t min, uint8_t max,
+                                    AdPresence presence = AdPresence::Always, uint8_t index = 0) {
+    return AutoDiscoveryEntity{AdComponent::Fan, name, valueTemplate, id, "", "", "", "", "", presets, min, max, presence, index};
+}
+
+constexpr AutoDiscoveryEntity adLight(const char *name, const char *valueTemplate, const char *id, AdOptions effects) {
+    return AutoDiscoveryEntity{AdComponent::Light, name, valueTemplate, id, "", "", "", "", "", effects, 0, 0, AdPresence::Always, 0};
+}
+
+/// @brief The parts of a table row that are only known at runtime.
+struct AutoDiscoveryRuntime {
+    const char* const* options = nullptr;
+    size_t optionCount = 0;
+    int min = 0;                // Fan speed range
+    int max = 0;
+};
+
+/// @brief Discovery topic component for an entity type (sensor, binary_sensor, ...).
+const char* adComponentName(AdComponent component);
+
+/// @brief Write the discovery topic of a single entity config into a caller supplied buffer.
+/// @param size Size of topic, AD_TOPIC_SIZE is enough for any serial number
+/// @return Length of the topic
+size_t adDiscoveryTopic(char* topic, size_t size, const SpaADInformationTemplate& spa, const char* type, const char* propertyId);
+
+/// @brief Write the discovery topic of the device config into a caller supplied buffer.
+size_t adDeviceDiscoveryTopic(char* topic, size_t size, const SpaADInformationTemplate& spa);
+
+/// @brief The document to publish, json itself or its abbreviated form built in compact if spa.abbreviate is set.
+const JsonDocument& compactAdJSON(const JsonDocument& json, const SpaADInformationTemplate& spa, JsonDocument& compact);
+
 /// @brief Generate JSON string to publish for Sensor auto discovery
 /// @param output String to revceive JSON output
 /// @param config Structure to define entity information
 /// @param spa Structure to define Spa information
-/// @param discoveryTopic String to retun discovrery topic
 /// @param type String to provide the type
-void generateCommonAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic, String type);
-
-void generateSensorAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic, String stateClass="", String unitOfMeasure="");
-void generateBinarySensorAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic);
-void generateTextAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic, String regex="");
-void generateSwitchAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic);
+void generateCommonAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String type);
 
-template <typename T, size_t N>
-void generateSelectAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic, const std::array<T, N>& options) {
-   JsonDocument json;
-   generateCommonAdJSON(json, config, spa, discoveryTopic, "select");
+void generateSensorAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String stateClass="", String unitOfMeasure="");
+void generateBinarySensorAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa);
+void generateTextAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String regex="");
+void generateSwitchAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa);
 
-   json["command_topic"] = spa.commandTopic + "/" + config.propertyId;
-   JsonArray opts = json["options"].to<JsonArray>();
-   for (const auto& o : options) opts.add(o);
+void generateSelectAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, const char* const* options, size_t optionsSize);
 
-   serializeJson(json, output);
+template <size_t N>
+void generateSelectAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, const std::array<const char*, N>& options) {
+   generateSelectAdJSON(json, config, spa, options.data(), N);
 }
 
-void generateFanAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic, int min, int max, const String* modes, const size_t modesSize=0);
-
-template <typename T, size_t N>
-void generateLightAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic, const std::array<T, N>& colorModes) {
-   JsonDocument json;
-   generateCommonAdJSON(json, config, spa, discoveryTopic, "light");
-
-   json["brightness_state_topic"] = spa.stateTopic;
-   json["color_mode_state_topic"] = spa.stateTopic;
-   json["effect_state_topic"] = spa.stateTopic;
-   json["hs_state_topic"] = spa.stateTopic;
-
-   json["command_topic"] = spa.commandTopic + "/" + config.propertyId + "_state";
-   json["brightness_command_topic"] = spa.commandTopic + "/" + config.propertyId + "_brightness";
-   json["effect_command_topic"] = spa.commandTopic + "/" + config.propertyId + "_effect";
-   json["hs_command_topic"] = spa.commandTopic + "/" + config.propertyId + "_color";
-
-   // Find the last character that is not a space or curly brace
-   int lastIndex = config.valueTemplate.length() - 1;
-   while (lastIndex >= 0 && (config.valueTemplate[lastIndex] == ' ' || config.valueTemplate[lastIndex] == '}')) {
-      lastIndex--;
-   }
-
-   // Value templates to extract values from the same topic
-   json["state_value_template"] = config.valueTemplate.substring(0, lastIndex + 1) + ".state" + config.valueTemplate.substring(lastIndex + 1);
-   json["brightness_value_template"] = config.valueTemplate.substring(0, lastIndex + 1) + ".brightness" + config.valueTemplate.substring(lastIndex + 1);
-   json["effect_value_template"] = config.valueTemplate.substring(0, lastIndex + 1) + ".effect" + config.valueTemplate.substring(lastIndex + 1);
-   json["hs_value_template"] = config.valueTemplate.substring(0, lastIndex + 1) + ".color.h" + config.valueTemplate.substring(lastIndex + 1) + ","
-                              + config.valueTemplate.substring(0, lastIndex + 1) + ".color.s" + config.valueTemplate.substring(lastIndex + 1);
-   json["color_mode_value_template"] = config.valueTemplate.substring(0, lastIndex + 1) + ".color_mode" + config.valueTemplate.substring(lastIndex + 1);
-
-   json["brightness"] = true;
-   json["brightness_scale"]=5;
-   json["effect"] = true;
-   JsonArray effect_list = json["effect_list"].to<JsonArray>();
-   for (const auto& effect: colorModes) effect_list.add(effect);
-   JsonArray color_modes = json["supported_color_modes"].to<JsonArray>();
-   color_modes.add("hs");
-
-   serializeJson(json, output);
+void generateFanAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, int min, int max, const char* const* modes, const size_t modesSize=0);
+
+void generateLightAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, const char* const* colorModes, size_t colorModesSize);
+
+template <size_t N>
+void generateLightAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, const std::array<const char*, N>& colorModes) {
+   generateLightAdJSON(json, config, spa, colorModes.data(), N);
 }
 
-void generateClimateAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic);
+void generateClimateAdJSON(JsonDocument& json, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa);
+
+/// @brief Generate the discovery JSON for a table row.
+/// @param entity Row of the discovery table
+/// @param runtime Option list and speed range resolved for the row
+void generateEntityAdJSON(JsonDocument& json, const AutoDiscoveryEntity& entity, const SpaADInformationTemplate& spa, const AutoDiscoveryRuntime& runtime);
+
+/// @brief Start a device discovery document (Home Assistant 2024.11+), one config holding every entity.
+///
+/// Add the entities with addDeviceComponentAdJSON, the device, origin, availability and state topic are shared.
+void generateDeviceAdJSON(JsonDocument& json, const SpaADInformationTemplate& spa);
+
+/// @brief Move an entity generated by generateEntityAdJSON into a device document.
+void addDeviceComponentAdJSON(JsonDocument& device, JsonDocument& entity, AdComponent component, const SpaADInformationTemplate& spa);
+
+/// @brief Add a component that only gives its platform, which removes the entity from the device.
+void removeDeviceComponentAdJSON(JsonDocument& device, AdComponent component, const char* propertyId, const SpaADInformationTemplate& spa);
 
 /*
 struct SensorAdConfig {
@@ -0,0 +1,191 @@
+#include "InfluxExporter.h"
+#include "SpaUtils.h"
+#include <esp_heap_caps.h>
+#include <new>
+#include <time.h>
+
+void InfluxExporter::setServer(const String &host, int port) {
+    _host = host;
+    _port = port;
+    _resolved = false;
+    _failed = false;
+    _baseline = false;
+
+    // Packets queued for the previous collector are not sent to the new one
+    _head = 0;
+    _count = 0;
+
+    if (isEnabled() || _host.length() == 0) return;
+    if (!allocateBuffers()) {
+        _host = "";
+        return;
+    }
+    configTime(0, 0, INFLUX_NTP_SERVER);
+}
+
+void InfluxExporter::setChangedOnly(bool changedOnly) {
+    _changedOnly = changedOnly;
+    _baseline = false;
+}
+
+void InfluxExporter::setSerialNumber(const String &serialNumber) {
+    _serialNumber = serialNumber;
+}
+
+bool InfluxExporter::allocateBuffers() {
+    size_t bytes = sizeof(InfluxPacket) * INFLUX_BACKLOG_PACKETS;
+
+    if (_backlog == nullptr) {
+        #if defined(SPACTRLPCB)
+        _backlog = (InfluxPacket *)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+        #endif
+        if (_backlog == nullptr) _backlog = (InfluxPacket *)malloc(bytes);
+    }
+    if (!_fieldHashes) _fieldHashes.reset(new (std::nothrow) uint32_t[INFLUX_MAX_FIELDS]);
+    if (!_writer) _writer.reset(new (std::nothrow) InfluxLineWriter(*this));
+
+    if (_backlog == nullptr || !_fieldHashes || !_writer) {
+        debugE("Unable to allocate %u bytes of InfluxDB buffers, exporter disabled",
+            bytes + sizeof(uint32_t) * INFLUX_MAX_FIELDS + sizeof(InfluxLineWriter));
+        return false;
+    }
+    return true;
+}
+
+void InfluxExporter::exportFrame(SpaInterface &si) {
+    if (!isEnabled()) return;
+
+    time_t now = time(nullptr);
+    if (now < 1577836800) {  // before 2020, SNTP has not set the clock yet
+        if (!_clockSet) debugD("InfluxDB export waiting for SNTP time");
+        return;
+    }
+    if (!_clockSet) debugI("InfluxDB export started, clock set by SNTP");
+    _clockSet = true;
+
+    char timestamp[24];
+    snprintf(timestamp, sizeof(timestamp), "%lu000000000", (unsigned long)now);
+
+    uint32_t dropped = _packetsDropped;
+    _fieldIndex = 0;
+    _writer->beginFrame(timestamp);
+    si.visitProperties(*this);
+    _writer->endFrame();
+
+    // If queued changes were dropped send every field next frame so the database catches up.
+    _baseline = _packetsDropped == dropped;
+
+    sendBacklog();
+}
+
+void InfluxExporter::loop() {
+    if (_count > 0) sendBacklog();
+}
+
+void InfluxExporter::beginGroup(const char *name) {
+    char series[96];
+    snprintf(series, sizeof(series), "spa,serial=%s,register=%s", _serialNumber.c_str(), name);
+    _writer->startLine(series);
+}
+
+void InfluxExporter::endGroup() {
+    _writer->finishLine();
+}
+
+void InfluxExporter::visit(const char *name, int value) {
+    char buffer[13];
+    writeField(name, buffer, snprintf(buffer, sizeof(buffer), "%ii", value));
+}
+
+void InfluxExporter::visit(const char *name, bool value) {
+    writeField(name, value ? "true" : "false", value ? 4 : 5);
+}
+
+void InfluxExporter::visit(const char *name, time_t value) {
+    char buffer[22];
+    writeField(name, buffer, snprintf(buffer, sizeof(buffer), "%lii", (long)value));
+}
+
+void InfluxExporter::visit(const char *name, const String &value) {
+    // Quoted and escaped, long values are truncated (the controller strings are short)
+    char buffer[96];
+    size_t length = 0;
+    buffer[length++] = '"';
+    for (size_t i = 0; i < value.length() && length < sizeof(buffer) - 3; i++) {
+        char c = value[i];
+        if (c == '"' || c == '\\') buffer[length++] = '\\';
+        else if ((uint8_t)c < 0x20) c = ' ';
+        buffer[length++] = c;
+    }
+    buffer[length++] = '"';
+    writeField(name, buffer, length);
+}
+
+void InfluxExporter::visit(const char *name, FixedPoint<1> value) {
+    char buffer[FixedPoint<1>::maxChars];
+    writeField(name, buffer, value.toChars(buffer, sizeof(buffer)));
+}
+
+void InfluxExporter::visit(const char *name, FixedPoint<2> value) {
+    char buffer[FixedPoint<2>::maxChars];
+    writeField(name, buffer, value.toChars(buffer, sizeof(buffer)));
+}
+
+void InfluxExporter::writeField(const char *name, const char *value, size_t length) {
+    // Fields are identified by their position in the visit order
+    uint32_t hash = fnv1a(value, length);
+    uint16_t index = _fieldIndex++;
+    if (index < INFLUX_MAX_FIELDS) {
+        bool unchanged = _baseline && _fieldHashes[index] == hash;
+        _fieldHashes[index] = hash;
+        if (_changedOnly && unchanged) return;
+    }
+
+    // Property names are plain identifiers so the key needs no escaping.
+    _writer->writeField(name, value, length);
+}
+
+void InfluxExporter::queuePacket(const InfluxPacket &packet) {
+    if (_count == INFLUX_BACKLOG_PACKETS) {
+        _head = (_head + 1) % INFLUX_BACKLOG_PACKETS;
+        _count--;
+        _packetsDropped++;
+    }
+
+    InfluxPacket &slot = _backlog[(_head + _count) % INFLUX_BACKLOG_PACKETS];
+    slot.length = packet.length;
+    memcpy(slot.data, packet.data, packet.length);
+    _count++;
+}
+
+void InfluxExporter::sendBacklog() {
+    if (WiFi.status() != WL_CONNECTED) return;
+    if (_failed && millis() - _lastFailure < retryInterval) return;
+
+    if (!_resolved) {
+        _resolved = WiFi.hostByName(_host.c_str(), _address) == 1;
+        if (!_resolved) {
+            debugW("Unable to resolve InfluxDB host %s", _host.c_str());
+            _failed = true;
+            _lastFailure = millis();
+            return;
+        }
+    }
+
+    while (_count > 0) {
+        const InfluxPacket &packet = _backlog[_head];
+        if (!_udp.beginPacket(_address, _port)
+            || _udp.write((const uint8_t *)packet.data, packet.length) != packet.length
+            || !_udp.endPacket()) {
+            debugW("InfluxDB send failed, %u packets queued", _count);
+            _failed = true;
+            _lastFailure = millis();
+            _resolved = false;  // the address may have changed
+            return;
+        }
+        _head = (_head + 1) % INFLUX_BACKLOG_PACKETS;
+        _count--;
+        _packetsSent++;
+    }
+    _failed = false;
+}
@@ -0,0 +1,111 @@
+#ifndef INFLUXEXPORTER_H
+#define INFLUXEXPORTER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <RemoteDebug.h>
+#include <memory>
+#include "SpaInterface.h"
+#include "InfluxLine.h"
+
+extern RemoteDebug Debug;
+
+// Packets held while the collector can not be reached, can be overridden with build flags.
+#if defined(SPACTRLPCB)
+  // S3 board - the backlog is placed in PSRAM when it is available.
+  #ifndef INFLUX_BACKLOG_PACKETS
+    #define INFLUX_BACKLOG_PACKETS 128
+  #endif
+#else
+  #ifndef INFLUX_BACKLOG_PACKETS
+    #define INFLUX_BACKLOG_PACKETS 8
+  #endif
+#endif
+
+// Fields tracked for change detection, must be at least the number of properties visited.
+#ifndef INFLUX_MAX_FIELDS
+  #define INFLUX_MAX_FIELDS 256
+#endif
+
+// Points are stamped with UTC from SNTP (the spa clock is local time), started with the exporter.
+#ifndef INFLUX_NTP_SERVER
+  #define INFLUX_NTP_SERVER "pool.ntp.org"
+#endif
+
+/// @brief Sends decoded RF frames to InfluxDB (or Telegraf) as line protocol over UDP.
+///
+/// Each frame is written as one line per register (measurement "spa", tags serial and
+/// register), stamped with the time it was decoded so backlogged points keep their time.
+/// Frames are skipped until SNTP has set the clock.  Lines are packed into datagrams of at
+/// most INFLUX_PACKET_SIZE bytes and queued; when the network is down the queue keeps the
+/// newest INFLUX_BACKLOG_PACKETS datagrams and sends them once it is back.  The buffers are
+/// only allocated once a collector is set.
+class InfluxExporter : public PropertyVisitor, private InfluxPacketSink {
+    public:
+        /// @brief Set the collector, an empty host disables the exporter.  Anything still queued is dropped.
+        void setServer(const String &host, int port);
+
+        /// @brief Only send fields that changed since the previous frame.
+        void setChangedOnly(bool changedOnly);
+
+        void setSerialNumber(const String &serialNumber);
+
+        bool isEnabled() const { return _host.length() > 0 && _writer != nullptr; }
+
+        /// @brief Queue a decoded frame and try to send the backlog.
+        void exportFrame(SpaInterface &si);
+
+        /// @brief Retry sending the backlog, call from loop().
+        void loop();
+
+        uint32_t getPacketsSent() const { return _packetsSent; }
+        uint32_t getPacketsDropped() const { return _packetsDropped; }
+        uint16_t getBacklogSize() const { return _count; }
+
+        void beginGroup(const char *name) override;
+        void endGroup() override;
+        void visit(const char *name, int value) override;
+        void visit(const char *name, bool value) override;
+        void visit(const char *name, time_t value) override;
+        void visit(const char *name, const String &value) override;
+        void visit(const char *name, FixedPoint<1> value) override;
+        void visit(const char *name, FixedPoint<2> value) override;
+
+    private:
+        static const unsigned long retryInterval = 5000;
+
+        WiFiUDP _udp;
+        String _host;
+        uint16_t _port = 8089;
+        IPAddress _address;
+        bool _resolved = false;
+        unsigned long _lastFailure = 0;
+        bool _failed = false;
+
+        bool _changedOnly = false;
+        String _serialNumber;
+
+        // Backlog ring, oldest packet at _head
+        InfluxPacket *_backlog = nullptr;
+        uint16_t _head = 0;
+        uint16_t _count = 0;
+        uint32_t _packetsSent = 0;
+        uint32_t _packetsDropped = 0;
+
+        // Frame being written
+        std::unique_ptr<InfluxLineWriter> _writer;
+        bool _clockSet = false;
+
+        // FNV-1a of every field as last sent, indexed in visit order
+        std::unique_ptr<uint32_t[]> _fieldHashes;
+        uint16_t _fieldIndex = 0;
+        bool _baseline = false;
+
+        bool allocateBuffers();
+        void writeField(const char *name, const char *value, size_t length);
+        void queuePacket(const InfluxPacket &packet) override;
+        void sendBacklog();
+};
+
+#endif // INFLUXEXPORTER_H
@@ -0,0 +1,66 @@
+#include "InfluxLine.h"
+#include <string.h>
+
+void InfluxLineWriter::beginFrame(const char *timestamp) {
+    _timestamp = timestamp;
+    _timestampLength = strlen(timestamp);
+    _packet.length = 0;
+    _lineFields = 0;
+}
+
+void InfluxLineWriter::startLine(const char *series) {
+    // Leave room for the space before the fields and the timestamp
+    size_t length = strlen(series);
+    if (length > sizeof(_line) / 2) length = sizeof(_line) / 2;
+    memcpy(_line, series, length);
+    _line[length++] = ' ';
+    _seriesLength = length;
+    _lineLength = length;
+    _lineFields = 0;
+}
+
+void InfluxLineWriter::writeField(const char *name, const char *value, size_t length) {
+    size_t nameLength = strlen(name);
+    // name '=' value after a ',', then the line ends with ' ' timestamp '\n'
+    size_t fieldLength = nameLength + 1 + length;
+    size_t tail = (_timestampLength > 0 ? 1 + _timestampLength : 0) + 1;
+    if (_lineLength + (_lineFields > 0 ? 1 : 0) + fieldLength + tail > sizeof(_line)) {
+        if (_lineFields == 0) return;  // would not fit an empty line either
+        finishLine();
+        _lineLength = _seriesLength;
+        if (_lineLength + fieldLength + tail > sizeof(_line)) return;
+    }
+
+    if (_lineFields > 0) _line[_lineLength++] = ',';
+    memcpy(_line + _lineLength, name, nameLength);
+    _lineLength += nameLength;
+    _line[_lineLength++] = '=';
+    memcpy(_line + _lineLength, value, length);
+    _lineLength += length;
+    _lineFields++;
+}
+
+void InfluxLineWriter::finishLine() {
+    if (_lineFields == 0) return;
+    _lineFields = 0;
+
+    size_t length = _lineLength;
+    if (_timestampLength > 0) {
+        _line[length++] = ' ';
+        memcpy(_line + length, _timestamp, _timestampLength);
+        length += _timestampLength;
+    }
+    _line[length++] = '\n';
+
+    if (_packet.length + length > sizeof(_packet.data)) {
+        _sink.queuePacket(_packet);
+        _packet.length = 0;
+    }
+    memcpy(_packet.data + _packet.length, _line, length);
+    _packet.length += length;
+}
+
+void InfluxLineWriter::endFrame() {
+    if (_packet.length > 0) _sink.queuePacket(_packet);
+    _packet.length = 0;
+}
@@ -0,0 +1,63 @@
+#ifndef INFLUXLINE_H
+#define INFLUXLINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest datagram sent, keeps packets below a 1500 byte Ethernet MTU after the IP and UDP headers.
+#ifndef INFLUX_PACKET_SIZE
+  #define INFLUX_PACKET_SIZE 1400
+#endif
+
+/// @brief One UDP datagram of complete line protocol lines.
+struct InfluxPacket {
+    uint16_t length;
+    char data[INFLUX_PACKET_SIZE];
+};
+
+/// @brief Receives the packets written by an InfluxLineWriter.
+class InfluxPacketSink {
+    public:
+        virtual ~InfluxPacketSink() {}
+        virtual void queuePacket(const InfluxPacket &packet) = 0;
+};
+
+/// @brief Writes InfluxDB line protocol and packs the lines into datagrams.
+///
+/// Lines never span packets and never exceed INFLUX_PACKET_SIZE, a line that would is
+/// split into several lines of the same series.  Field values are written as given, the
+/// caller formats and escapes them.  Has no Arduino dependencies so it is unit tested on
+/// the host (test/test_influx_line).
+class InfluxLineWriter {
+    public:
+        explicit InfluxLineWriter(InfluxPacketSink &sink) : _sink(sink) {}
+
+        /// @brief Start a frame.
+        /// @param timestamp Appended to every line (nanoseconds since 1970), not copied
+        void beginFrame(const char *timestamp);
+
+        /// @brief Start a line.
+        /// @param series Measurement and tags, eg "spa,serial=1,register=R2"
+        void startLine(const char *series);
+
+        /// @brief Add a field to the line, dropped if it could not fit a packet on its own.
+        void writeField(const char *name, const char *value, size_t length);
+
+        /// @brief End the line, a line without fields is not written.
+        void finishLine();
+
+        /// @brief Hand the partly filled packet to the sink.
+        void endFrame();
+
+    private:
+        InfluxPacketSink &_sink;
+        InfluxPacket _packet = {};
+        char _line[INFLUX_PACKET_SIZE];
+        size_t _seriesLength = 0;   // The series at the start of _line, kept for continuation lines
+        size_t _lineLength = 0;
+        uint16_t _lineFields = 0;
+        const char *_timestamp = "";
+        size_t _timestampLength = 0;
+};
+
+#endif // INFLUXLINE_H
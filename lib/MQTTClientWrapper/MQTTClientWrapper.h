@@ -3,6 +3,41 @@
 
 #include <PubSubClient.h>
 #include <WiFiClient.h>
+#include <ArduinoJson.h>
+
+
+/// @brief Collects small writes from a serializer into chunks before they go to the socket.
+class BufferedPrint : public Print
+{
+    public:
+        BufferedPrint(Print &client) : _client(client) {}
+
+        size_t write(uint8_t c) override {
+            _buffer[_length++] = c;
+            if (_length == sizeof(_buffer)) flushBuffer();
+            return 1;
+        }
+
+        size_t write(const uint8_t *data, size_t size) override {
+            for (size_t i = 0; i < size; i++) write(data[i]);
+            return size;
+        }
+
+        void flushBuffer() {
+            if (_length == 0) return;
+            _written += _client.write(_buffer, _length);
+            _length = 0;
+        }
+
+        /// @brief Bytes accepted by the client so far.
+        size_t written() const { return _written; }
+
+    private:
+        Print &_client;
+        uint8_t _buffer[128];
+        size_t _length = 0;
+        size_t _written = 0;
+};
 
 
 class MQTTClientWrapper : public PubSubClient
@@ -54,6 +89,43 @@ class MQTTClientWrapper : public PubSubClient
             return PubSubClient::connect(_id.c_str(), _user.c_str(), _pass.c_str(), _willTopic.c_str(), willQos, willRetain, _willMessage.c_str(), cleanSession);
          }
 
+        /// @brief Publish a JSON document without building the payload in RAM.
+        ///
+        /// The payload length is found with measureJson, then the document is serialized straight
+        /// to the socket with beginPublish / endPublish, so it is not limited by setBufferSize.
+        /// @return True if the whole payload was written
+        bool publishJson(const char *topic, const JsonDocument &json, bool retained = false) {
+            size_t length = measureJson(json);
+            if (!beginPublish(topic, length, retained)) return false;
+
+            BufferedPrint writer(*this);
+            serializeJson(json, writer);
+            writer.flushBuffer();
+
+            return endPublish() && writer.written() == length;
+        }
+
+        /// @brief As publishJson, but encoded as MessagePack.
+        /// The document must not hold serialized() values, those are copied through as is.
+        bool publishMsgPack(const char *topic, const JsonDocument &json, bool retained = false) {
+            size_t length = measureMsgPack(json);
+            if (!beginPublish(topic, length, retained)) return false;
+
+            BufferedPrint writer(*this);
+            serializeMsgPack(json, writer);
+            writer.flushBuffer();
+
+            return endPublish() && writer.written() == length;
+        }
+
+        /// @brief Publish a payload of any size, written straight to the socket rather than via the PubSubClient buffer.
+        /// @return True if the whole payload was written
+        bool publishPayload(const char *topic, const String &payload, bool retained = false) {
+            if (!beginPublish(topic, payload.length(), retained)) return false;
+            size_t written = write((const uint8_t *)payload.c_str(), payload.length());
+            return endPublish() && written == payload.length();
+        }
+
     private:
         String _serverAddress;
         String _id;
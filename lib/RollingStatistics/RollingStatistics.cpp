@@ -0,0 +1,57 @@
+#include "RollingStatistics.h"
+
+void RollingStatistics::setWindow(uint8_t window) {
+    if (window < 2) window = 2;
+    if (window > maxWindow) window = maxWindow;
+    _window = window;
+    clear();
+}
+
+void RollingStatistics::clear() {
+    _next = 0;
+    _count = 0;
+    _sum = 0;
+    _min = 0;
+    _max = 0;
+    _ewma = 0;
+}
+
+void RollingStatistics::add(int value) {
+    if (_count == 0) {
+        _min = value;
+        _max = value;
+        _ewma = value;
+    } else {
+        _ewma += (2.0f / (_window + 1)) * (value - _ewma);
+    }
+
+    bool rescanNeeded = false;
+    if (_count == _window) {
+        int evicted = _samples[_next];
+        _sum -= evicted;
+        // Only need to look at the whole window again if the reading leaving it was the min or max.
+        rescanNeeded = (evicted == _min && value > _min) || (evicted == _max && value < _max);
+    } else {
+        _count++;
+    }
+
+    _samples[_next] = value;
+    _next = (_next + 1) % _window;
+    _sum += value;
+
+    if (rescanNeeded) {
+        rescan();
+    } else {
+        if (value < _min) _min = value;
+        if (value > _max) _max = value;
+    }
+}
+
+void RollingStatistics::rescan() {
+    _min = _samples[0];
+    _max = _samples[0];
+    for (uint8_t i = 1; i < _count; i++) {
+        if (_samples[i] < _min) _min = _samples[i];
+        if (_samples[i] > _max) _max = _samples[i];
+    }
+}
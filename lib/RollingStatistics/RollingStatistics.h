@@ -0,0 +1,43 @@
+#ifndef ROLLINGSTATISTICS_H
+#define ROLLINGSTATISTICS_H
+
+#include <stdint.h>
+
+/// @brief Incremental min, max, mean and EWMA over the last N readings of a property.
+///
+/// Updated from the parse path, so each reading costs O(1) (min / max are only rescanned
+/// when the reading that held them drops out of the window).
+class RollingStatistics
+{
+public:
+    static const uint8_t maxWindow = 60;
+
+    /// @brief Set the number of readings in the window (2 - maxWindow).  Clears the statistics.
+    void setWindow(uint8_t window);
+    uint8_t getWindow() const { return _window; }
+
+    void add(int value);
+    void clear();
+
+    /// @brief Number of readings currently in the window.
+    uint8_t getCount() const { return _count; }
+    int getMin() const { return _min; }
+    int getMax() const { return _max; }
+    float getMean() const { return _count == 0 ? 0 : (float)_sum / _count; }
+    /// @brief Exponentially weighted moving average, alpha = 2 / (window + 1).
+    float getEWMA() const { return _ewma; }
+
+private:
+    int32_t _samples[maxWindow];
+    uint8_t _window = 10;
+    uint8_t _next = 0;
+    uint8_t _count = 0;
+    int32_t _sum = 0;
+    int _min = 0;
+    int _max = 0;
+    float _ewma = 0;
+
+    void rescan();
+};
+
+#endif // ROLLINGSTATISTICS_H
@@ -0,0 +1,53 @@
+#include "SpaCommand.h"
+#include <string.h>
+
+/// @brief Confirm the name really is the pattern the hash selected, any other name could collide.
+static SpaCommandName matchSpaCommand(const char *name, const char *pattern, SpaCommand command, uint8_t index) {
+  if (strcmp(name, pattern) != 0) return SpaCommandName{SpaCommand::Unknown, 0};
+  return SpaCommandName{command, index};
+}
+
+SpaCommandName lookupSpaCommand(const char *name, size_t length) {
+  char pattern[24];
+  uint8_t index = 0;
+  uint32_t hash = 2166136261u;
+
+  if (length >= sizeof(pattern)) return SpaCommandName{SpaCommand::Unknown, 0};
+  for (size_t i = 0; i < length; i++) {
+    char c = name[i];
+    if (c == '#') return SpaCommandName{SpaCommand::Unknown, 0};  // only a placeholder in the patterns
+    if (index == 0 && c >= '0' && c <= '9') {
+      index = c - '0';
+      c = '#';
+    }
+    pattern[i] = c;
+    hash = (hash ^ (uint8_t)c) * 16777619u;
+  }
+  pattern[length] = '\0';
+
+  // A hash collision between two of these is a duplicate case label, so it can not go unnoticed.
+  #define SPA_COMMAND(name, command) case fnv1aConst(name): return matchSpaCommand(pattern, name, command, index)
+  switch (hash) {
+    SPA_COMMAND("temperatures_setPoint", SpaCommand::SetPoint);
+    SPA_COMMAND("heatpump_mode", SpaCommand::HeatPumpMode);
+    SPA_COMMAND("heatpump_auxheat", SpaCommand::HeatPumpAuxHeat);
+    SPA_COMMAND("pump#_speed", SpaCommand::PumpSpeed);
+    SPA_COMMAND("pump#_mode", SpaCommand::PumpMode);
+    SPA_COMMAND("pump#_state", SpaCommand::PumpState);
+    SPA_COMMAND("status_datetime", SpaCommand::DateTime);
+    SPA_COMMAND("status_spaMode", SpaCommand::SpaMode);
+    SPA_COMMAND("lights_state", SpaCommand::LightsState);
+    SPA_COMMAND("lights_effect", SpaCommand::LightsEffect);
+    SPA_COMMAND("lights_brightness", SpaCommand::LightsBrightness);
+    SPA_COMMAND("lights_color", SpaCommand::LightsColor);
+    SPA_COMMAND("lights_speed", SpaCommand::LightsSpeed);
+    SPA_COMMAND("blower_state", SpaCommand::BlowerState);
+    SPA_COMMAND("blower_speed", SpaCommand::BlowerSpeed);
+    SPA_COMMAND("blower_mode", SpaCommand::BlowerMode);
+    SPA_COMMAND("sleepTimers_#_state", SpaCommand::SleepTimerState);
+    SPA_COMMAND("sleepTimers_#_begin", SpaCommand::SleepTimerBegin);
+    SPA_COMMAND("sleepTimers_#_end", SpaCommand::SleepTimerEnd);
+  }
+  #undef SPA_COMMAND
+  return SpaCommandName{SpaCommand::Unknown, 0};
+}
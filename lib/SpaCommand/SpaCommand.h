@@ -0,0 +1,49 @@
+#ifndef SPACOMMAND_H
+#define SPACOMMAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief FNV-1a of a string, usable in constant expressions (case labels).
+constexpr uint32_t fnv1aConst(const char *s, uint32_t hash = 2166136261u) {
+  return *s == '\0' ? hash : fnv1aConst(s + 1, (hash ^ (uint8_t)*s) * 16777619u);
+}
+
+/// @brief Commands accepted on <base>/set/<name> and by the web UI /set form.
+enum class SpaCommand : uint8_t {
+  Unknown,
+  SetPoint,           // temperatures_setPoint
+  HeatPumpMode,       // heatpump_mode
+  HeatPumpAuxHeat,    // heatpump_auxheat
+  PumpSpeed,          // pump#_speed
+  PumpMode,           // pump#_mode
+  PumpState,          // pump#_state
+  DateTime,           // status_datetime
+  SpaMode,            // status_spaMode
+  LightsState,        // lights_state
+  LightsEffect,       // lights_effect
+  LightsBrightness,   // lights_brightness
+  LightsColor,        // lights_color
+  LightsSpeed,        // lights_speed
+  BlowerState,        // blower_state
+  BlowerSpeed,        // blower_speed
+  BlowerMode,         // blower_mode
+  SleepTimerState,    // sleepTimers_#_state
+  SleepTimerBegin,    // sleepTimers_#_begin
+  SleepTimerEnd,      // sleepTimers_#_end
+};
+
+/// @brief A command name resolved by lookupSpaCommand.
+struct SpaCommandName {
+  SpaCommand command;
+  uint8_t index;      // Pump or sleep timer number (the # in the name), 0 if there is none
+};
+
+/// @brief Resolve a command name without allocating.
+///
+/// The first digit in the name is taken as the pump or timer number and hashed as '#', the
+/// hash then selects the command with a switch over hashes computed at compile time.
+/// @param name Last level of the topic, or the form field name
+SpaCommandName lookupSpaCommand(const char *name, size_t length);
+
+#endif // SPACOMMAND_H
@@ -0,0 +1,133 @@
+#include "SpaHistory.h"
+#include <esp_heap_caps.h>
+
+const uint32_t SpaHistory::tierInterval[SpaHistory::TIERS] = {0, 60, 900};
+
+bool HistoryRing::begin(uint16_t capacity, bool preferPsram) {
+    size_t bytes = sizeof(HistorySample) * capacity;
+
+    _samples = nullptr;
+    if (preferPsram) _samples = (HistorySample *)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    if (_samples == nullptr) _samples = (HistorySample *)malloc(bytes);
+    if (_samples == nullptr) {
+        debugE("Unable to allocate %u bytes of history", bytes);
+        return false;
+    }
+
+    _capacity = capacity;
+    _head = 0;
+    _count = 0;
+    return true;
+}
+
+void HistoryRing::push(const HistorySample &sample) {
+    if (_samples == nullptr) return;
+
+    _samples[_head] = sample;
+    _head = (_head + 1) % _capacity;
+    if (_count < _capacity) _count++;
+}
+
+size_t HistoryRing::writeTo(Print &out) const {
+    if (_count == 0) return 0;
+
+    // Oldest sample is at _head once the ring has wrapped, so this is at most two contiguous writes.
+    uint16_t oldest = (_head + _capacity - _count) % _capacity;
+    uint16_t firstRun = min((uint16_t)(_capacity - oldest), _count);
+
+    size_t written = out.write((const uint8_t *)&_samples[oldest], firstRun * sizeof(HistorySample));
+    if (firstRun < _count) {
+        written += out.write((const uint8_t *)&_samples[0], (_count - firstRun) * sizeof(HistorySample));
+    }
+    return written;
+}
+
+void HistoryAccumulator::add(const HistorySample &sample) {
+    count++;
+    WTMP += sample.WTMP;
+    STMP += sample.STMP;
+    Power += sample.Power;
+    MainsCurrent += sample.MainsCurrent;
+    heaterDuty += sample.heaterDuty;
+    pumps |= sample.pumps;
+}
+
+HistorySample HistoryAccumulator::mean(uint32_t interval) const {
+    HistorySample sample;
+    sample.time = bucket * interval;
+    sample.WTMP = WTMP / count;
+    sample.STMP = STMP / count;
+    sample.Power = Power / count;
+    sample.MainsCurrent = MainsCurrent / count;
+    sample.heaterDuty = heaterDuty / count;
+    sample.pumps = pumps;
+    return sample;
+}
+
+bool SpaHistory::begin() {
+    #if defined(SPACTRLPCB)
+    bool preferPsram = true;
+    #else
+    bool preferPsram = false;
+    #endif
+
+    _initialised = _rings[TIER_RAW].begin(HISTORY_RAW_SAMPLES, preferPsram)
+        && _rings[TIER_MINUTE].begin(HISTORY_MINUTE_SAMPLES, preferPsram)
+        && _rings[TIER_QUARTER].begin(HISTORY_QUARTER_SAMPLES, preferPsram);
+
+    if (!_initialised) debugE("History disabled");
+    return _initialised;
+}
+
+void SpaHistory::record(const SpaStatusSnapshot &snapshot) {
+    if (!_initialised) return;
+
+    HistorySample sample;
+    sample.time = snapshot.SpaTime;
+    sample.WTMP = snapshot.WTMP.raw();
+    sample.STMP = snapshot.STMP.raw();
+    sample.Power = snapshot.Power.raw();
+    sample.MainsCurrent = snapshot.MainsCurrent.raw();
+    sample.heaterDuty = snapshot.RB_TP_Heater ? 100 : 0;
+    sample.pumps = 0;
+    for (int pump = 0; pump < 5; pump++) {
+        if (snapshot.RB_TP_Pump[pump] != 0) sample.pumps |= 1 << pump;
+    }
+
+    _rings[TIER_RAW].push(sample);
+
+    // Close the 1 minute bucket once a sample from a later (or, if the clock was set back, earlier) minute arrives.
+    uint32_t minuteBucket = sample.time / tierInterval[TIER_MINUTE];
+    if (_minute.count > 0 && _minute.bucket != minuteBucket) {
+        HistorySample minuteSample = _minute.mean(tierInterval[TIER_MINUTE]);
+        _rings[TIER_MINUTE].push(minuteSample);
+
+        uint32_t quarterBucket = minuteSample.time / tierInterval[TIER_QUARTER];
+        if (_quarter.count > 0 && _quarter.bucket != quarterBucket) {
+            _rings[TIER_QUARTER].push(_quarter.mean(tierInterval[TIER_QUARTER]));
+            _quarter = HistoryAccumulator();
+        }
+        _quarter.bucket = quarterBucket;
+        _quarter.add(minuteSample);
+
+        _minute = HistoryAccumulator();
+    }
+    _minute.bucket = minuteBucket;
+    _minute.add(sample);
+}
+
+size_t SpaHistory::exportSize(uint8_t tier) const {
+    if (!isValidTier(tier)) return 0;
+    return sizeof(HistoryExportHeader) + _rings[tier].size() * sizeof(HistorySample);
+}
+
+size_t SpaHistory::exportTier(uint8_t tier, Print &out) const {
+    if (!isValidTier(tier)) return 0;
+
+    HistoryExportHeader header = {{'S', 'N', 'H', '1'}, 1, tier, sizeof(HistorySample),
+        _rings[tier].size(), (uint16_t)tierInterval[tier], _rings[tier].capacity()};
+
+    size_t written = out.write((const uint8_t *)&header, sizeof(header));
+    written += _rings[tier].writeTo(out);
+    return written;
+}
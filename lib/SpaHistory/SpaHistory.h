@@ -0,0 +1,134 @@
+#ifndef SPAHISTORY_H
+#define SPAHISTORY_H
+
+#include <Arduino.h>
+#include <RemoteDebug.h>
+#include "SpaInterface.h"
+
+extern RemoteDebug Debug;
+
+// Ring sizes per tier, can be overridden with build flags.
+#if defined(SPACTRLPCB)
+  // S3 board - buffers are placed in PSRAM when it is available.
+  #ifndef HISTORY_RAW_SAMPLES
+    #define HISTORY_RAW_SAMPLES 360         // every poll, >= 1 hour at the fastest poll rate
+  #endif
+  #ifndef HISTORY_MINUTE_SAMPLES
+    #define HISTORY_MINUTE_SAMPLES 2880     // 48 hours of 1 minute aggregates
+  #endif
+  #ifndef HISTORY_QUARTER_SAMPLES
+    #define HISTORY_QUARTER_SAMPLES 2880    // 30 days of 15 minute aggregates
+  #endif
+#else
+  #ifndef HISTORY_RAW_SAMPLES
+    #define HISTORY_RAW_SAMPLES 360         // every poll, >= 1 hour at the fastest poll rate
+  #endif
+  #ifndef HISTORY_MINUTE_SAMPLES
+    #define HISTORY_MINUTE_SAMPLES 360      // 6 hours of 1 minute aggregates
+  #endif
+  #ifndef HISTORY_QUARTER_SAMPLES
+    #define HISTORY_QUARTER_SAMPLES 672     // 7 days of 15 minute aggregates
+  #endif
+#endif
+
+/// @brief A single history record.
+///
+/// Raw samples hold one reading, aggregated tiers hold the mean over the bucket.
+/// The layout is also the on-the-wire format of the binary export (little endian).
+struct HistorySample {
+    uint32_t time;          // Spa time (seconds since 1970) of the reading / start of the bucket
+    int16_t WTMP;           // Water temperature ('C * 10)
+    int16_t STMP;           // Set point ('C * 10)
+    int32_t Power;          // Power (W * 10)
+    int16_t MainsCurrent;   // Mains current (A * 10)
+    uint8_t heaterDuty;     // Percent of the bucket the heater was on (0 or 100 for raw samples)
+    uint8_t pumps;          // Bit per pump (bit 0 = pump 1), set if the pump ran during the bucket
+};
+static_assert(sizeof(HistorySample) == 16, "HistorySample is part of the export format");
+
+/// @brief Header written in front of the samples by SpaHistory::exportTier.
+struct HistoryExportHeader {
+    char magic[4];          // "SNH1"
+    uint8_t version;        // Export format version (1)
+    uint8_t tier;           // 0 = raw, 1 = 1 minute, 2 = 15 minute
+    uint16_t sampleSize;    // sizeof(HistorySample)
+    uint16_t count;         // Number of samples that follow, oldest first
+    uint16_t interval;      // Bucket size in seconds (0 for raw samples)
+    uint32_t capacity;      // Maximum number of samples held for this tier
+};
+static_assert(sizeof(HistoryExportHeader) == 16, "HistoryExportHeader is part of the export format");
+
+/// @brief Fixed size ring of history samples.
+class HistoryRing {
+    public:
+        /// @brief Allocate the storage, prefers PSRAM when requested and available.
+        bool begin(uint16_t capacity, bool preferPsram);
+
+        void push(const HistorySample &sample);
+
+        uint16_t size() const { return _count; }
+        uint16_t capacity() const { return _capacity; }
+
+        /// @brief Write the samples oldest first.
+        /// @return bytes written
+        size_t writeTo(Print &out) const;
+
+    private:
+        HistorySample *_samples = nullptr;
+        uint16_t _capacity = 0;
+        uint16_t _head = 0;     // Next slot to write
+        uint16_t _count = 0;
+};
+
+/// @brief Running totals for one aggregation bucket.
+struct HistoryAccumulator {
+    uint32_t bucket = 0;
+    uint16_t count = 0;
+    int32_t WTMP = 0;
+    int32_t STMP = 0;
+    int32_t Power = 0;
+    int32_t MainsCurrent = 0;
+    uint32_t heaterDuty = 0;
+    uint8_t pumps = 0;
+
+    void add(const HistorySample &sample);
+    HistorySample mean(uint32_t interval) const;
+};
+
+/// @brief On device history of the key spa properties.
+///
+/// Every decoded frame is kept as a raw sample and rolled up into 1 minute and
+/// 15 minute aggregates.  Memory use is fixed at begin().
+class SpaHistory {
+    public:
+        static const uint8_t TIER_RAW = 0;
+        static const uint8_t TIER_MINUTE = 1;
+        static const uint8_t TIER_QUARTER = 2;
+        static const uint8_t TIERS = 3;
+
+        /// @brief Allocate the ring buffers.
+        /// @return False if there was not enough memory, history is then disabled.
+        bool begin();
+
+        /// @brief Add a frame to the history.
+        void record(const SpaStatusSnapshot &snapshot);
+
+        bool isValidTier(int tier) const { return tier >= 0 && tier < TIERS && _initialised; }
+
+        /// @brief Number of bytes exportTier will write.
+        size_t exportSize(uint8_t tier) const;
+
+        /// @brief Write a tier in the compact binary format (HistoryExportHeader followed by the samples).
+        /// @return bytes written
+        size_t exportTier(uint8_t tier, Print &out) const;
+
+    private:
+        static const uint32_t tierInterval[TIERS];
+
+        HistoryRing _rings[TIERS];
+        HistoryAccumulator _minute;
+        HistoryAccumulator _quarter;
+        bool _initialised = false;
+};
+
+#endif // SPAHISTORY_H
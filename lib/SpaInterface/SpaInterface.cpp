@@ -70,7 +70,10 @@ String SpaInterface::sendCommandReturnResult(String cmd) {
 bool SpaInterface::sendCommandCheckResult(String cmd, String expected){
     String result = sendCommandReturnResult(cmd);
     bool outcome = result == expected;
-    if (!outcome) debugW("Sent comment %s, expected %s, got %s",cmd.c_str(),expected.c_str(),result.c_str());
+    if (!outcome) {
+        _commandErrors++;
+        debugW("Sent comment %s, expected %s, got %s",cmd.c_str(),expected.c_str(),result.c_str());
+    }
     return outcome;
 }
 
@@ -230,12 +233,9 @@ bool SpaInterface::setHPMP(int mode){
 bool SpaInterface::setHPMP(String mode){
     debugD("setHPMP - %s", mode.c_str());
 
-    for (uint x=0; x<HPMPStrings.size(); x++) {
-        if (HPMPStrings[x] == mode) {
-            return setHPMP(x);
-        }
-    }
-    return false;
+    int index = lookupIndex(HPMPStrings, mode.c_str());
+    if (index < 0) return false;
+    return setHPMP(index);
 }
 
 bool SpaInterface::setColorMode(int mode){
@@ -252,12 +252,9 @@ bool SpaInterface::setColorMode(int mode){
 
 bool SpaInterface::setColorMode(String mode){
     debugD("setColorMode - %s", mode.c_str());
-    for (uint x=0; x<colorModeStrings.size(); x++) {
-        if (colorModeStrings[x] == mode) {
-            return setColorMode(x);
-        }
-    }
-    return false;
+    int index = lookupIndex(colorModeStrings, mode.c_str());
+    if (index < 0) return false;
+    return setColorMode(index);
 }
 
 bool SpaInterface::setLBRTValue(int mode){
@@ -364,7 +361,7 @@ bool SpaInterface::setMode(int mode){
     String smode = String(mode);
 
     if (sendCommandCheckResult("W66:"+smode,smode)) {
-        update_Mode(spaModeStrings[mode]);
+        update_Mode(lookupString(spaModeStrings, mode));
         return true;
     }
     return false;
@@ -372,12 +369,9 @@ bool SpaInterface::setMode(int mode){
 
 bool SpaInterface::setMode(String mode){
     debugD("setMode - %s", mode.c_str());
-    for (uint x=0; x<spaModeStrings.size(); x++) {
-        if (spaModeStrings[x] == mode) {
-            return setMode(x);
-        }
-    }
-    return false;
+    int index = lookupIndex(spaModeStrings, mode.c_str());
+    if (index < 0) return false;
+    return setMode(index);
 }
 
 
@@ -468,6 +462,7 @@ bool SpaInterface::readStatus() {
     }
 
     updateMeasures();
+    publishSnapshot();
     _resultRegistersDirty = false;
     validStatusResponse = true;
 
@@ -488,11 +483,18 @@ void SpaInterface::updateStatus() {
     sendCommand("RF");
 
     _nextUpdateDue = millis() + FAILEDREADFREQUENCY;    
+    _statusReads++;
     if (readStatus()) {
         debugD("readStatus returned true");
         _nextUpdateDue = millis() + (_updateFrequency * 1000);
         _initialised = true;
-        if (updateCallback != nullptr) { updateCallback(); }
+        if (capabilityChanges != 0) {
+            if (capabilitiesCallback != nullptr) { capabilitiesCallback(capabilityChanges); }
+            capabilityChanges = 0;
+        }
+        checkPublish();
+    } else {
+        _statusReadErrors++;
     }
 }
 
@@ -506,6 +508,11 @@ void SpaInterface::loop(){
     if (_resultRegistersDirty) {
         _nextUpdateDue = millis() + 200;  // if we need to read the registers, pause a bit to see if there are more commands coming.
         _resultRegistersDirty = false;
+        _publishImmediately = true;       // show the result of the command without waiting for the publish interval
+    }
+
+    if (_publishPending && millis() - _lastPublish >= _publishMinInterval) {
+        publish();
     }
 
     if (millis()>_nextUpdateDue) {
@@ -524,6 +531,147 @@ void SpaInterface::clearUpdateCallback() {
 }
 
 
+void SpaInterface::setCapabilitiesCallback(void (*f)(uint8_t changed)) {
+    capabilitiesCallback = f;
+}
+
+
+void SpaInterface::setPublishPolicy(int minInterval, int heartbeat) {
+    _publishMinInterval = minInterval * 1000UL;
+    _publishHeartbeat = heartbeat * 1000UL;
+}
+
+
+void SpaInterface::checkPublish() {
+    SpaStatusSnapshot current;
+    getSnapshot(current);
+
+    unsigned long sinceLast = millis() - _lastPublish;
+
+    if (!_published || _publishHeartbeat == 0 || _publishImmediately
+        || isSignificantChange(_publishedSnapshot, current)) {
+        publish();
+    } else if (isMeasurementChange(_publishedSnapshot, current)) {
+        if (sinceLast >= _publishMinInterval) publish();
+        else _publishPending = true;    // sent from loop() once the interval is up
+    } else if (sinceLast >= _publishHeartbeat) {
+        publish();
+    }
+}
+
+
+void SpaInterface::publish() {
+    getSnapshot(_publishedSnapshot);
+    _published = true;
+    _publishPending = false;
+    _publishImmediately = false;
+    _lastPublish = millis();
+    if (updateCallback != nullptr) { updateCallback(); }
+}
+
+
+bool SpaInterface::isSignificantChange(const SpaStatusSnapshot &previous, const SpaStatusSnapshot &current) {
+    for (int pump = 0; pump < 5; pump++) {
+        if (previous.RB_TP_Pump[pump] != current.RB_TP_Pump[pump]) return true;
+    }
+    return previous.STMP != current.STMP
+        || previous.RB_TP_Heater != current.RB_TP_Heater
+        || previous.RB_TP_Ozone != current.RB_TP_Ozone
+        || previous.RB_TP_Light != current.RB_TP_Light
+        || previous.HPMP != current.HPMP
+        || previous.HELE != current.HELE
+        || previous.Outlet_Blower != current.Outlet_Blower
+        || previous.VARIValue != current.VARIValue
+        || previous.L_1SNZ_DAY != current.L_1SNZ_DAY
+        || previous.L_2SNZ_DAY != current.L_2SNZ_DAY
+        || previous.L_1SNZ_BGN != current.L_1SNZ_BGN
+        || previous.L_1SNZ_END != current.L_1SNZ_END
+        || previous.L_2SNZ_BGN != current.L_2SNZ_BGN
+        || previous.L_2SNZ_END != current.L_2SNZ_END
+        || previous.LSPDValue != current.LSPDValue
+        || previous.ColorMode != current.ColorMode
+        || previous.LBRTValue != current.LBRTValue
+        || previous.CurrClr != current.CurrClr;
+}
+
+
+bool SpaInterface::isMeasurementChange(const SpaStatusSnapshot &previous, const SpaStatusSnapshot &current) {
+    // SpaTime is left out, it changes on every read.
+    return previous.WTMP != current.WTMP
+        || previous.HeaterTemperature != current.HeaterTemperature
+        || previous.CaseTemperature != current.CaseTemperature
+        || previous.HP_Ambient != current.HP_Ambient
+        || previous.HP_Condensor != current.HP_Condensor
+        || previous.MainsVoltage != current.MainsVoltage
+        || previous.MainsCurrent != current.MainsCurrent
+        || previous.Power != current.Power
+        || previous.Power_kWh != current.Power_kWh;
+}
+
+
+void SpaInterface::publishSnapshot() {
+    // Seqlock writer - bump the sequence to odd, write, then bump back to even.
+    // Readers that see an odd or changed sequence throw their copy away and retry.
+    uint32_t sequence = _snapshotSequence.load(std::memory_order_relaxed);
+    _snapshotSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    _snapshot.STMP = getSTMP();
+    _snapshot.WTMP = getWTMP();
+    _snapshot.HeaterTemperature = getHeaterTemperature();
+    _snapshot.CaseTemperature = getCaseTemperature();
+    _snapshot.HP_Ambient = getHP_Ambient();
+    _snapshot.HP_Condensor = getHP_Condensor();
+
+    _snapshot.MainsVoltage = getMainsVoltage();
+    _snapshot.MainsCurrent = getMainsCurrent();
+    _snapshot.Power = getPower();
+    _snapshot.Power_kWh = getPower_kWh();
+
+    _snapshot.RB_TP_Heater = getRB_TP_Heater();
+    _snapshot.RB_TP_Ozone = getRB_TP_Ozone();
+    _snapshot.RB_TP_Light = getRB_TP_Light();
+    for (int pump = 0; pump < 5; pump++) {
+        _snapshot.RB_TP_Pump[pump] = (this->*(pumpStateFunctions[pump]))();
+    }
+
+    _snapshot.HPMP = getHPMP();
+    _snapshot.HELE = getHELE();
+
+    _snapshot.SpaTime = getSpaTime();
+
+    _snapshot.Outlet_Blower = getOutlet_Blower();
+    _snapshot.VARIValue = getVARIValue();
+
+    _snapshot.L_1SNZ_DAY = getL_1SNZ_DAY();
+    _snapshot.L_2SNZ_DAY = getL_2SNZ_DAY();
+    _snapshot.L_1SNZ_BGN = getL_1SNZ_BGN();
+    _snapshot.L_1SNZ_END = getL_1SNZ_END();
+    _snapshot.L_2SNZ_BGN = getL_2SNZ_BGN();
+    _snapshot.L_2SNZ_END = getL_2SNZ_END();
+
+    _snapshot.LSPDValue = getLSPDValue();
+    _snapshot.ColorMode = getColorMode();
+    _snapshot.LBRTValue = getLBRTValue();
+    _snapshot.CurrClr = getCurrClr();
+
+    _snapshotSequence.store(sequence + 2, std::memory_order_release);
+}
+
+
+void SpaInterface::getSnapshot(SpaStatusSnapshot &snapshot) const {
+    uint32_t before;
+    uint32_t after = 0;
+    do {
+        before = _snapshotSequence.load(std::memory_order_acquire);
+        if (before & 1) continue; // writer is part way through a frame
+        snapshot = _snapshot;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = _snapshotSequence.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+}
+
+
 void SpaInterface::updateMeasures() {
     #pragma region R2
     update_MainsCurrent(statusResponseRaw[R2+1]);
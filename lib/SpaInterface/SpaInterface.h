@@ -2,6 +2,7 @@
 #define SPAINTERFACE_H
 
 #include <Arduino.h>
+#include <atomic>
 #include <functional>
 #include <stdexcept>
 #include <RemoteDebug.h>
@@ -10,6 +11,50 @@
 extern RemoteDebug Debug;
 #define FAILEDREADFREQUENCY 1000 //(ms) Frequency to retry on a failed read of the status registers.
 
+/// @brief Numeric properties decoded from a single RF frame.
+///
+/// Plain data only (no String members) so it can be copied under the seqlock
+/// without touching the heap.  Values keep the controller's scaling (eg WTMP 385 = 38.5'C),
+/// the FixedPoint members carry that scale in their type.
+struct SpaStatusSnapshot {
+    FixedPoint<1> STMP;
+    FixedPoint<1> WTMP;
+    FixedPoint<1> HeaterTemperature;
+    int CaseTemperature = 0;
+    int HP_Ambient = 0;
+    int HP_Condensor = 0;
+
+    int MainsVoltage = 0;
+    FixedPoint<1> MainsCurrent;
+    FixedPoint<1> Power;
+    FixedPoint<2> Power_kWh;
+
+    bool RB_TP_Heater = false;
+    bool RB_TP_Ozone = false;
+    int RB_TP_Light = 0;
+    int RB_TP_Pump[5] = {0, 0, 0, 0, 0};
+
+    int HPMP = 0;
+    bool HELE = false;
+
+    time_t SpaTime = 0;
+
+    int Outlet_Blower = 0;
+    int VARIValue = 0;
+
+    int L_1SNZ_DAY = 0;
+    int L_2SNZ_DAY = 0;
+    int L_1SNZ_BGN = 0;
+    int L_1SNZ_END = 0;
+    int L_2SNZ_BGN = 0;
+    int L_2SNZ_END = 0;
+
+    int LSPDValue = 0;
+    int ColorMode = 0;
+    int LBRTValue = 0;
+    int CurrClr = 0;
+};
+
 class SpaInterface : public SpaProperties {
     private:
 
@@ -64,6 +109,15 @@ class SpaInterface : public SpaProperties {
 
         void updateMeasures();
 
+        /// @brief Copy of the numeric properties from the last good RF frame.
+        SpaStatusSnapshot _snapshot;
+
+        /// @brief Seqlock sequence guarding _snapshot.  Odd while a frame is being written.
+        std::atomic<uint32_t> _snapshotSequence{0};
+
+        /// @brief Copies the current property values into _snapshot under the seqlock.
+        /// Must only be called from the task that polls the spa (single writer).
+        void publishSnapshot();
 
 
         /// @brief Sends command to SpaNet controller.  Result must be read by some other method.
@@ -101,9 +155,32 @@ class SpaInterface : public SpaProperties {
 
    
         void (*updateCallback)() = nullptr;
+        void (*capabilitiesCallback)(uint8_t changed) = nullptr;
+
+        /// @brief Publish policy, see setPublishPolicy
+        unsigned long _publishMinInterval = 0;
+        unsigned long _publishHeartbeat = 0;
+        unsigned long _lastPublish = 0;
+        bool _published = false;
+        bool _publishPending = false;
+        bool _publishImmediately = false;
+        SpaStatusSnapshot _publishedSnapshot;
+
+        /// @brief Decide whether the frame just read should be passed to updateCallback.
+        void checkPublish();
+        void publish();
+
+        /// @brief True if a state the user controls (set point, pumps, lights, heater, ...) differs.
+        static bool isSignificantChange(const SpaStatusSnapshot &previous, const SpaStatusSnapshot &current);
+        /// @brief True if any of the measured values differ.
+        static bool isMeasurementChange(const SpaStatusSnapshot &previous, const SpaStatusSnapshot &current);
 
         u_long _lastWaitMessage = millis();
 
+        uint32_t _statusReads = 0;
+        uint32_t _statusReadErrors = 0;
+        uint32_t _commandErrors = 0;
+
 
 
     public:
@@ -133,6 +210,40 @@ class SpaInterface : public SpaProperties {
         /// @brief Clear the call back function.
         void clearUpdateCallback();
 
+        /// @brief Set the function to be called when a pump install state or HP_Present changes.
+        ///
+        /// Called once per status read with the changed bits, see SpaProperties::capabilityPump.
+        /// @param f 
+        void setCapabilitiesCallback(void (*f)(uint8_t changed));
+
+        /// @brief Limit how often the update callback is called.
+        ///
+        /// Significant changes (user controlled states, heater on/off) and the first read after a
+        /// command are published straight away.  Other changes are published at most every
+        /// minInterval seconds, and with no change at all only every heartbeat seconds.
+        /// @param minInterval seconds, 0 publishes measurement changes on every read
+        /// @param heartbeat seconds, 0 publishes every read whether anything changed or not
+        void setPublishPolicy(int minInterval, int heartbeat);
+
+        /// @brief Get a coherent copy of the numeric properties from one RF frame.
+        ///
+        /// Lock free and safe to call from any core while the spa is being polled,
+        /// the copy is retried if a new frame is published part way through.
+        /// @param snapshot receives the values
+        void getSnapshot(SpaStatusSnapshot &snapshot) const;
+
+        /// @brief Number of RF status reads attempted since boot.
+        uint32_t getStatusReadCount() const { return _statusReads; }
+
+        /// @brief Number of RF status reads that were incomplete or corrupted.
+        uint32_t getStatusReadErrorCount() const { return _statusReadErrors; }
+
+        /// @brief Number of commands the controller did not acknowledge as expected.
+        uint32_t getCommandErrorCount() const { return _commandErrors; }
+
+        /// @brief Number of snapshots published so far, changes whenever a new RF frame is decoded.
+        uint32_t getSnapshotVersion() const { return _snapshotSequence.load(std::memory_order_acquire) >> 1; }
+
         /// @brief Set the desired water temperature
         /// @param temp Between 5 and 40 in 0.5 increments
         /// @return Returns True if succesful
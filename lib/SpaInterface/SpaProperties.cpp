@@ -1,5 +1,17 @@
 #include "SpaProperties.h"
 
+// Storage for the lookup tables (needed until C++17 inline variables).
+constexpr std::array<const char*, 4> SpaProperties::spaModeStrings;
+constexpr std::array<const char*, 2> SpaProperties::autoPumpOptions;
+constexpr std::array<const char*, 5> SpaProperties::pumpStateStrings;
+constexpr std::array<const char*, 2> SpaProperties::blowerStrings;
+constexpr std::array<int, 25> SpaProperties::colorMap;
+constexpr std::array<const char*, 5> SpaProperties::colorModeStrings;
+constexpr std::array<const char*, 5> SpaProperties::lightSpeedMap;
+constexpr std::array<const char*, 11> SpaProperties::sleepSelection;
+constexpr std::array<byte, 11> SpaProperties::sleepBitmap;
+constexpr std::array<const char*, 4> SpaProperties::HPMPStrings;
+
 
 inline boolean isNumber(String s) {
     if (s.isEmpty()) {
@@ -13,12 +25,292 @@ inline boolean isNumber(String s) {
     return true;
 }
 
+PumpCapabilities PumpCapabilities::decode(const char *installState) {
+    PumpCapabilities pump;
+    pump.installed = installState[0] == '1';
+
+    const char *firstDash = strchr(installState, '-');
+    const char *secondDash = strrchr(installState, '-');
+    if (firstDash == nullptr || secondDash == firstDash) return pump;
+
+    pump.speedType = atoi(firstDash + 1);
+    for (const char *c = secondDash + 1; *c != '\0'; c++) {
+        if (*c < '0' || *c > '0' + STATE_AUTO) continue;
+        uint8_t state = *c - '0';
+        pump.possibleStates |= 1 << state;
+        if (state >= STATE_ON && state <= STATE_HIGH) {
+            if (pump.speedMin == 0 || state < pump.speedMin) pump.speedMin = state;
+            if (state > pump.speedMax) pump.speedMax = state;
+        }
+    }
+    return pump;
+}
+
+void SpaProperties::visitProperties(PropertyVisitor &visitor) {
+    visitor.beginGroup("R2");
+    visitor.visit("MainsCurrent", MainsCurrent.getValue());
+    visitor.visit("MainsVoltage", MainsVoltage.getValue());
+    visitor.visit("CaseTemperature", CaseTemperature.getValue());
+    visitor.visit("PortCurrent", PortCurrent.getValue());
+    visitor.visit("SpaTime", SpaTime.getValue());
+    visitor.visit("HeaterTemperature", HeaterTemperature.getValue());
+    visitor.visit("PoolTemperature", PoolTemperature.getValue());
+    visitor.visit("WaterPresent", WaterPresent.getValue());
+    visitor.visit("AwakeMinutesRemaining", AwakeMinutesRemaining.getValue());
+    visitor.visit("FiltPumpRunTimeTotal", FiltPumpRunTimeTotal.getValue());
+    visitor.visit("FiltPumpReqMins", FiltPumpReqMins.getValue());
+    visitor.visit("LoadTimeOut", LoadTimeOut.getValue());
+    visitor.visit("HourMeter", HourMeter.getValue());
+    visitor.visit("Relay1", Relay1.getValue());
+    visitor.visit("Relay2", Relay2.getValue());
+    visitor.visit("Relay3", Relay3.getValue());
+    visitor.visit("Relay4", Relay4.getValue());
+    visitor.visit("Relay5", Relay5.getValue());
+    visitor.visit("Relay6", Relay6.getValue());
+    visitor.visit("Relay7", Relay7.getValue());
+    visitor.visit("Relay8", Relay8.getValue());
+    visitor.visit("Relay9", Relay9.getValue());
+    visitor.endGroup();
+
+    visitor.beginGroup("R3");
+    visitor.visit("CLMT", CLMT.getValue());
+    visitor.visit("PHSE", PHSE.getValue());
+    visitor.visit("LLM1", LLM1.getValue());
+    visitor.visit("LLM2", LLM2.getValue());
+    visitor.visit("LLM3", LLM3.getValue());
+    visitor.visit("SVER", SVER.getValue());
+    visitor.visit("Model", Model.getValue());
+    visitor.visit("SerialNo1", SerialNo1.getValue());
+    visitor.visit("SerialNo2", SerialNo2.getValue());
+    visitor.visit("D1", D1.getValue());
+    visitor.visit("D2", D2.getValue());
+    visitor.visit("D3", D3.getValue());
+    visitor.visit("D4", D4.getValue());
+    visitor.visit("D5", D5.getValue());
+    visitor.visit("D6", D6.getValue());
+    visitor.visit("Pump", Pump.getValue());
+    visitor.visit("LS", LS.getValue());
+    visitor.visit("HV", HV.getValue());
+    visitor.visit("SnpMR", SnpMR.getValue());
+    visitor.visit("Status", Status.getValue());
+    visitor.visit("PrimeCount", PrimeCount.getValue());
+    visitor.visit("EC", EC.getValue());
+    visitor.visit("HAMB", HAMB.getValue());
+    visitor.visit("HCON", HCON.getValue());
+    visitor.visit("HV_2", HV_2.getValue());
+    visitor.endGroup();
+
+    visitor.beginGroup("R4");
+    visitor.visit("Mode", Mode.getValue());
+    visitor.visit("Ser1_Timer", Ser1_Timer.getValue());
+    visitor.visit("Ser2_Timer", Ser2_Timer.getValue());
+    visitor.visit("Ser3_Timer", Ser3_Timer.getValue());
+    visitor.visit("HeatMode", HeatMode.getValue());
+    visitor.visit("PumpIdleTimer", PumpIdleTimer.getValue());
+    visitor.visit("PumpRunTimer", PumpRunTimer.getValue());
+    visitor.visit("AdtPoolHys", AdtPoolHys.getValue());
+    visitor.visit("AdtHeaterHys", AdtHeaterHys.getValue());
+    visitor.visit("Power", Power.getValue());
+    visitor.visit("Power_kWh", Power_kWh.getValue());
+    visitor.visit("Power_Today", Power_Today.getValue());
+    visitor.visit("Power_Yesterday", Power_Yesterday.getValue());
+    visitor.visit("ThermalCutOut", ThermalCutOut.getValue());
+    visitor.visit("Test_D1", Test_D1.getValue());
+    visitor.visit("Test_D2", Test_D2.getValue());
+    visitor.visit("Test_D3", Test_D3.getValue());
+    visitor.visit("ElementHeatSourceOffset", ElementHeatSourceOffset.getValue());
+    visitor.visit("Frequency", Frequency.getValue());
+    visitor.visit("HPHeatSourceOffset_Heat", HPHeatSourceOffset_Heat.getValue());
+    visitor.visit("HPHeatSourceOffset_Cool", HPHeatSourceOffset_Cool.getValue());
+    visitor.visit("HeatSourceOffTime", HeatSourceOffTime.getValue());
+    visitor.visit("Vari_Speed", Vari_Speed.getValue());
+    visitor.visit("Vari_Percent", Vari_Percent.getValue());
+    visitor.visit("Vari_Mode", Vari_Mode.getValue());
+    visitor.endGroup();
+
+    visitor.beginGroup("R5");
+    visitor.visit("RB_TP_Pump1", RB_TP_Pump1.getValue());
+    visitor.visit("RB_TP_Pump2", RB_TP_Pump2.getValue());
+    visitor.visit("RB_TP_Pump3", RB_TP_Pump3.getValue());
+    visitor.visit("RB_TP_Pump4", RB_TP_Pump4.getValue());
+    visitor.visit("RB_TP_Pump5", RB_TP_Pump5.getValue());
+    visitor.visit("RB_TP_Blower", RB_TP_Blower.getValue());
+    visitor.visit("RB_TP_Light", RB_TP_Light.getValue());
+    visitor.visit("RB_TP_Auto", RB_TP_Auto.getValue());
+    visitor.visit("RB_TP_Heater", RB_TP_Heater.getValue());
+    visitor.visit("RB_TP_Ozone", RB_TP_Ozone.getValue());
+    visitor.visit("RB_TP_Sleep", RB_TP_Sleep.getValue());
+    visitor.visit("WTMP", WTMP.getValue());
+    visitor.visit("CleanCycle", CleanCycle.getValue());
+    visitor.endGroup();
+
+    visitor.beginGroup("R6");
+    visitor.visit("VARIValue", VARIValue.getValue());
+    visitor.visit("LBRTValue", LBRTValue.getValue());
+    visitor.visit("CurrClr", CurrClr.getValue());
+    visitor.visit("ColorMode", ColorMode.getValue());
+    visitor.visit("LSPDValue", LSPDValue.getValue());
+    visitor.visit("FiltSetHrs", FiltSetHrs.getValue());
+    visitor.visit("FiltBlockHrs", FiltBlockHrs.getValue());
+    visitor.visit("STMP", STMP.getValue());
+    visitor.visit("L_24HOURS", L_24HOURS.getValue());
+    visitor.visit("PSAV_LVL", PSAV_LVL.getValue());
+    visitor.visit("PSAV_BGN", PSAV_BGN.getValue());
+    visitor.visit("PSAV_END", PSAV_END.getValue());
+    visitor.visit("L_1SNZ_DAY", L_1SNZ_DAY.getValue());
+    visitor.visit("L_2SNZ_DAY", L_2SNZ_DAY.getValue());
+    visitor.visit("L_1SNZ_BGN", L_1SNZ_BGN.getValue());
+    visitor.visit("L_2SNZ_BGN", L_2SNZ_BGN.getValue());
+    visitor.visit("L_1SNZ_END", L_1SNZ_END.getValue());
+    visitor.visit("L_2SNZ_END", L_2SNZ_END.getValue());
+    visitor.visit("DefaultScrn", DefaultScrn.getValue());
+    visitor.visit("TOUT", TOUT.getValue());
+    visitor.visit("VPMP", VPMP.getValue());
+    visitor.visit("HIFI", HIFI.getValue());
+    visitor.visit("BRND", BRND.getValue());
+    visitor.visit("PRME", PRME.getValue());
+    visitor.visit("ELMT", ELMT.getValue());
+    visitor.visit("TYPE", TYPE.getValue());
+    visitor.visit("GAS", GAS.getValue());
+    visitor.endGroup();
+
+    visitor.beginGroup("R7");
+    visitor.visit("WCLNTime", WCLNTime.getValue());
+    visitor.visit("TemperatureUnits", TemperatureUnits.getValue());
+    visitor.visit("OzoneOff", OzoneOff.getValue());
+    visitor.visit("Ozone24", Ozone24.getValue());
+    visitor.visit("Circ24", Circ24.getValue());
+    visitor.visit("CJET", CJET.getValue());
+    visitor.visit("VELE", VELE.getValue());
+    visitor.visit("V_Max", V_Max.getValue());
+    visitor.visit("V_Min", V_Min.getValue());
+    visitor.visit("V_Max_24", V_Max_24.getValue());
+    visitor.visit("V_Min_24", V_Min_24.getValue());
+    visitor.visit("CurrentZero", CurrentZero.getValue());
+    visitor.visit("CurrentAdjust", CurrentAdjust.getValue());
+    visitor.visit("VoltageAdjust", VoltageAdjust.getValue());
+    visitor.visit("Ser1", Ser1.getValue());
+    visitor.visit("Ser2", Ser2.getValue());
+    visitor.visit("Ser3", Ser3.getValue());
+    visitor.visit("VMAX", VMAX.getValue());
+    visitor.visit("AHYS", AHYS.getValue());
+    visitor.visit("HUSE", HUSE.getValue());
+    visitor.visit("HELE", HELE.getValue());
+    visitor.visit("HPMP", HPMP.getValue());
+    visitor.visit("PMIN", PMIN.getValue());
+    visitor.visit("PFLT", PFLT.getValue());
+    visitor.visit("PHTR", PHTR.getValue());
+    visitor.visit("PMAX", PMAX.getValue());
+    visitor.endGroup();
+
+    visitor.beginGroup("R9");
+    visitor.visit("F1_HR", F1_HR.getValue());
+    visitor.visit("F1_Time", F1_Time.getValue());
+    visitor.visit("F1_ER", F1_ER.getValue());
+    visitor.visit("F1_I", F1_I.getValue());
+    visitor.visit("F1_V", F1_V.getValue());
+    visitor.visit("F1_PT", F1_PT.getValue());
+    visitor.visit("F1_HT", F1_HT.getValue());
+    visitor.visit("F1_CT", F1_CT.getValue());
+    visitor.visit("F1_PU", F1_PU.getValue());
+    visitor.visit("F1_VE", F1_VE.getValue());
+    visitor.visit("F1_ST", F1_ST.getValue());
+    visitor.endGroup();
+
+    visitor.beginGroup("RA");
+    visitor.visit("F2_HR", F2_HR.getValue());
+    visitor.visit("F2_Time", F2_Time.getValue());
+    visitor.visit("F2_ER", F2_ER.getValue());
+    visitor.visit("F2_I", F2_I.getValue());
+    visitor.visit("F2_V", F2_V.getValue());
+    visitor.visit("F2_PT", F2_PT.getValue());
+    visitor.visit("F2_HT", F2_HT.getValue());
+    visitor.visit("F2_CT", F2_CT.getValue());
+    visitor.visit("F2_PU", F2_PU.getValue());
+    visitor.visit("F2_VE", F2_VE.getValue());
+    visitor.visit("F2_ST", F2_ST.getValue());
+    visitor.endGroup();
+
+    visitor.beginGroup("RB");
+    visitor.visit("F3_HR", F3_HR.getValue());
+    visitor.visit("F3_Time", F3_Time.getValue());
+    visitor.visit("F3_ER", F3_ER.getValue());
+    visitor.visit("F3_I", F3_I.getValue());
+    visitor.visit("F3_V", F3_V.getValue());
+    visitor.visit("F3_PT", F3_PT.getValue());
+    visitor.visit("F3_HT", F3_HT.getValue());
+    visitor.visit("F3_CT", F3_CT.getValue());
+    visitor.visit("F3_PU", F3_PU.getValue());
+    visitor.visit("F3_VE", F3_VE.getValue());
+    visitor.visit("F3_ST", F3_ST.getValue());
+    visitor.endGroup();
+
+    visitor.beginGroup("RC");
+    visitor.visit("Outlet_Blower", Outlet_Blower.getValue());
+    visitor.endGroup();
+
+    visitor.beginGroup("RE");
+    visitor.visit("HP_Present", HP_Present.getValue());
+    visitor.visit("HP_Ambient", HP_Ambient.getValue());
+    visitor.visit("HP_Condensor", HP_Condensor.getValue());
+    visitor.visit("HP_Compressor_State", HP_Compressor_State.getValue());
+    visitor.visit("HP_Fan_State", HP_Fan_State.getValue());
+    visitor.visit("HP_4W_Valve", HP_4W_Valve.getValue());
+    visitor.visit("HP_Heater_State", HP_Heater_State.getValue());
+    visitor.visit("HP_State", HP_State.getValue());
+    visitor.visit("HP_Mode", HP_Mode.getValue());
+    visitor.visit("HP_Defrost_Timer", HP_Defrost_Timer.getValue());
+    visitor.visit("HP_Comp_Run_Timer", HP_Comp_Run_Timer.getValue());
+    visitor.visit("HP_Low_Temp_Timer", HP_Low_Temp_Timer.getValue());
+    visitor.visit("HP_Heat_Accum_Timer", HP_Heat_Accum_Timer.getValue());
+    visitor.visit("HP_Sequence_Timer", HP_Sequence_Timer.getValue());
+    visitor.visit("HP_Warning", HP_Warning.getValue());
+    visitor.visit("FrezTmr", FrezTmr.getValue());
+    visitor.visit("DBGN", DBGN.getValue());
+    visitor.visit("DEND", DEND.getValue());
+    visitor.visit("DCMP", DCMP.getValue());
+    visitor.visit("DMAX", DMAX.getValue());
+    visitor.visit("DELE", DELE.getValue());
+    visitor.visit("DPMP", DPMP.getValue());
+    visitor.endGroup();
+
+    visitor.beginGroup("RG");
+    visitor.visit("Pump1InstallState", Pump1InstallState.getValue());
+    visitor.visit("Pump2InstallState", Pump2InstallState.getValue());
+    visitor.visit("Pump3InstallState", Pump3InstallState.getValue());
+    visitor.visit("Pump4InstallState", Pump4InstallState.getValue());
+    visitor.visit("Pump5InstallState", Pump5InstallState.getValue());
+    visitor.visit("Pump1OkToRun", Pump1OkToRun.getValue());
+    visitor.visit("Pump2OkToRun", Pump2OkToRun.getValue());
+    visitor.visit("Pump3OkToRun", Pump3OkToRun.getValue());
+    visitor.visit("Pump4OkToRun", Pump4OkToRun.getValue());
+    visitor.visit("Pump5OkToRun", Pump5OkToRun.getValue());
+    visitor.visit("LockMode", LockMode.getValue());
+    visitor.endGroup();
+}
+
+const PumpCapabilities& SpaProperties::getPumpCapabilities(int pumpNumber) const {
+    static const PumpCapabilities notInstalled;
+    if (pumpNumber < 1 || pumpNumber > 5) return notInstalled;
+    return pumpCapabilities[pumpNumber - 1];
+}
+
+void SpaProperties::setStatisticsWindow(uint8_t window) {
+    WTMPStatistics.setWindow(window);
+    HeaterTemperatureStatistics.setWindow(window);
+    CaseTemperatureStatistics.setWindow(window);
+    MainsVoltageStatistics.setWindow(window);
+    MainsCurrentStatistics.setWindow(window);
+    PowerStatistics.setWindow(window);
+}
+
 boolean SpaProperties::update_MainsCurrent(String s){
     if (!isNumber(s)) {
         return false;
     }
 
-    MainsCurrent.update_Value(s.toInt());
+    MainsCurrent.update_Value(FixedPoint<1>::fromRaw(s.toInt()));
+    MainsCurrentStatistics.add(MainsCurrent.getValue().raw());
     return true;
 }
 
@@ -43,6 +335,7 @@ boolean SpaProperties::update_MainsVoltage(String s){
     }
 
     MainsVoltage.update_Value(s.toInt());
+    MainsVoltageStatistics.add(MainsVoltage.getValue());
     return true;
 }
 
@@ -52,6 +345,7 @@ boolean SpaProperties::update_CaseTemperature(String s){
     }
 
     CaseTemperature.update_Value(s.toInt());
+    CaseTemperatureStatistics.add(CaseTemperature.getValue());
     return true;
 }
 
@@ -69,7 +363,8 @@ boolean SpaProperties::update_HeaterTemperature(String s){
         return false;
     }
 
-    HeaterTemperature.update_Value(s.toInt());
+    HeaterTemperature.update_Value(FixedPoint<1>::fromRaw(s.toInt()));
+    HeaterTemperatureStatistics.add(HeaterTemperature.getValue().raw());
     return true;
 }
 
@@ -491,7 +786,8 @@ boolean SpaProperties::update_Power(String s){
         return false;
     }
 
-    Power.update_Value(s.toInt());
+    Power.update_Value(FixedPoint<1>::fromRaw(s.toInt()));
+    PowerStatistics.add(Power.getValue().raw());
     return true;
 }
 
@@ -500,7 +796,7 @@ boolean SpaProperties::update_Power_kWh(String s){
         return false;
     }
 
-    Power_kWh.update_Value(s.toInt());
+    Power_kWh.update_Value(FixedPoint<2>::fromRaw(s.toInt()));
     return true;
 }
 
@@ -734,7 +1030,8 @@ boolean SpaProperties::update_WTMP(String s){
         return false;
     }
 
-    WTMP.update_Value(s.toInt());
+    WTMP.update_Value(FixedPoint<1>::fromRaw(s.toInt()));
+    WTMPStatistics.add(WTMP.getValue().raw());
     return true;
 }
 
@@ -815,7 +1112,7 @@ boolean SpaProperties::update_STMP(String s){
         return false;
     }
 
-    STMP.update_Value(s.toInt());
+    STMP.update_Value(FixedPoint<1>::fromRaw(s.toInt()));
     return true;
 }
 
@@ -1535,6 +1832,7 @@ boolean SpaProperties::update_HP_Present(String s){
         return false;
     }
 
+    if (s.toInt() != HP_Present.getValue()) capabilityChanges |= CAPABILITY_HEAT_PUMP;
     HP_Present.update_Value(s.toInt());
     return true;
 }
@@ -1731,26 +2029,46 @@ boolean SpaProperties::update_DPMP(String s){
 }
 
 boolean SpaProperties::update_Pump1InstallState(String s){
+    if (s != Pump1InstallState.getValue()) {
+        pumpCapabilities[0] = PumpCapabilities::decode(s.c_str());
+        capabilityChanges |= capabilityPump(1);
+    }
     Pump1InstallState.update_Value(s);
     return true;
 }
 
 boolean SpaProperties::update_Pump2InstallState(String s){
+    if (s != Pump2InstallState.getValue()) {
+        pumpCapabilities[1] = PumpCapabilities::decode(s.c_str());
+        capabilityChanges |= capabilityPump(2);
+    }
     Pump2InstallState.update_Value(s);
     return true;
 }
 
 boolean SpaProperties::update_Pump3InstallState(String s){
+    if (s != Pump3InstallState.getValue()) {
+        pumpCapabilities[2] = PumpCapabilities::decode(s.c_str());
+        capabilityChanges |= capabilityPump(3);
+    }
     Pump3InstallState.update_Value(s);
     return true;
 }
 
 boolean SpaProperties::update_Pump4InstallState(String s){
+    if (s != Pump4InstallState.getValue()) {
+        pumpCapabilities[3] = PumpCapabilities::decode(s.c_str());
+        capabilityChanges |= capabilityPump(4);
+    }
     Pump4InstallState.update_Value(s);
     return true;
 }
 
 boolean SpaProperties::update_Pump5InstallState(String s){
+    if (s != Pump5InstallState.getValue()) {
+        pumpCapabilities[4] = PumpCapabilities::decode(s.c_str());
+        capabilityChanges |= capabilityPump(5);
+    }
     Pump5InstallState.update_Value(s);
     return true;
 }
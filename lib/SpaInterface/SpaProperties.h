@@ -6,6 +6,8 @@
 #include <time.h>
 #include <TimeLib.h>
 #include <array>
+#include "FixedPoint.h"
+#include "RollingStatistics.h"
 
 
 template <typename T>
@@ -30,6 +32,81 @@ public:
     void clearCallback() { _callback = nullptr; };
 };
 
+/// @brief Index of the first entry of a lookup table equal to value.
+/// @return -1 if there is no match
+template <typename T, size_t N, typename V>
+int lookupIndex(const std::array<T, N> &table, V value)
+{
+    for (size_t i = 0; i < N; i++) {
+        if (table[i] == value) return i;
+    }
+    return -1;
+}
+
+/// @brief Index of the string value in a table of strings.
+/// @return -1 if there is no match
+template <size_t N>
+int lookupIndex(const std::array<const char*, N> &table, const char *value)
+{
+    for (size_t i = 0; i < N; i++) {
+        if (strcmp(table[i], value) == 0) return i;
+    }
+    return -1;
+}
+
+/// @brief Bounds checked read of a string table.
+/// @return fallback if index is out of range
+template <size_t N>
+const char* lookupString(const std::array<const char*, N> &table, int index, const char *fallback = "")
+{
+    return (index >= 0 && (size_t)index < N) ? table[index] : fallback;
+}
+
+/// @brief Receives every property from SpaProperties::visitProperties.
+///
+/// Properties are reported in register order, wrapped in beginGroup / endGroup per register (R2, R3, ...).
+class PropertyVisitor
+{
+public:
+    virtual ~PropertyVisitor() {}
+    virtual void beginGroup(const char *name) {}
+    virtual void endGroup() {}
+    virtual void visit(const char *name, int value) = 0;
+    virtual void visit(const char *name, bool value) = 0;
+    virtual void visit(const char *name, time_t value) = 0;
+    virtual void visit(const char *name, const String &value) = 0;
+    virtual void visit(const char *name, FixedPoint<1> value) = 0;
+    virtual void visit(const char *name, FixedPoint<2> value) = 0;
+};
+
+/// @brief Pump features decoded from its install state (eg "1-2-014").
+///
+/// Decoded once when the install state changes so readers do no string work.
+struct PumpCapabilities
+{
+    static const uint8_t STATE_OFF = 0;
+    static const uint8_t STATE_ON = 1;
+    static const uint8_t STATE_LOW = 2;
+    static const uint8_t STATE_HIGH = 3;
+    static const uint8_t STATE_AUTO = 4;
+
+    bool installed = false;
+    /// @brief Middle part of the install state (1 = single speed, 2 = two speed)
+    uint8_t speedType = 0;
+    /// @brief Bit per STATE_ the pump accepts
+    uint8_t possibleStates = 0;
+    /// @brief Lowest and highest of the ON / LOW / HIGH states, 0 if there are none
+    uint8_t speedMin = 0;
+    uint8_t speedMax = 0;
+
+    bool supports(uint8_t state) const { return possibleStates & (1 << state); }
+
+    /// @brief Number of states the pump accepts
+    uint8_t stateCount() const { return __builtin_popcount(possibleStates); }
+
+    static PumpCapabilities decode(const char *installState);
+};
+
 /// @brief represents the properties of the spa.
 class SpaProperties
 {
@@ -38,7 +115,7 @@ private:
 
 #pragma region R2
     /// @brief Mains current draw (A)
-    Property<int> MainsCurrent;
+    Property<FixedPoint<1>> MainsCurrent;
     /// @brief Mains voltage (V)
     Property<int> MainsVoltage;
     /// @brief Internal case temperature ('C)
@@ -49,7 +126,7 @@ private:
     // TODO #1 this should be settable.
     Property<time_t> SpaTime;
     /// @brief Heater temperature ('C)
-    Property<int> HeaterTemperature;
+    Property<FixedPoint<1>> HeaterTemperature;
     /// @brief Pool temperature ('C). Note this seems to return rubbish most of the time.
     Property<int> PoolTemperature;
     /// @brief Water present
@@ -176,8 +253,8 @@ Property<bool> HV_2;
     /// @brief  Heater temperature adaptive hysteresis
     Property<int> AdtHeaterHys;
     /// @brief Power consumtion * 10
-    Property<int> Power; 
-    Property<int> Power_kWh;
+    Property<FixedPoint<1>> Power;
+    Property<FixedPoint<2>> Power_kWh;
     // (kWh)
     Property<int> Power_Today;
     // (kWh)
@@ -245,7 +322,7 @@ Property<bool> HV_2;
     /// True when spa is sleeping due to sleep timer
     Property<bool> RB_TP_Sleep;
     /// @brief Water temperature ('C)
-    Property<int> WTMP;
+    Property<FixedPoint<1>> WTMP;
     /// @brief Clean cycle running
     ///
     /// True when a clean cycle is running
@@ -278,7 +355,7 @@ Property<bool> HV_2;
     /// @brief Filter block duration (hours)
     Property<int> FiltBlockHrs;
     /// @brief Water temperature set point ('C)
-    Property<int> STMP;
+    Property<FixedPoint<1>> STMP;
     // 1 = 12 hrs
     Property<int> L_24HOURS;
     /// @brief Power save level
@@ -612,9 +689,23 @@ Property<bool> HV_2;
     Property<int> LockMode;
 
 #pragma endregion
+#pragma region Statistics
+    RollingStatistics WTMPStatistics;
+    RollingStatistics HeaterTemperatureStatistics;
+    RollingStatistics CaseTemperatureStatistics;
+    RollingStatistics MainsVoltageStatistics;
+    RollingStatistics MainsCurrentStatistics;
+    RollingStatistics PowerStatistics;
+
+    /// @brief Pump1InstallState - Pump5InstallState decoded
+    PumpCapabilities pumpCapabilities[5];
+#pragma endregion
 
 
 protected:
+    /// @brief Capabilities that changed since the last status read, see capabilityPump
+    uint8_t capabilityChanges = 0;
+
 #pragma region R2
     boolean update_MainsCurrent(String);
     boolean update_SpaTime(String year, String month, String day, String hour, String minute, String second);
@@ -872,10 +963,10 @@ protected:
 
 
 public:
-    /// @brief Gets the mains current multiplied by 10 (77 = 7.7 actual)
+    /// @brief Gets the mains current (A) to one decimal (7.7)
     /// @return 
-    int getMainsCurrent() { return MainsCurrent.getValue(); }
-    void setMainsCurrentCallback(void (*callback)(int)) { MainsCurrent.setCallback(callback); }
+    FixedPoint<1> getMainsCurrent() { return MainsCurrent.getValue(); }
+    void setMainsCurrentCallback(void (*callback)(FixedPoint<1>)) { MainsCurrent.setCallback(callback); }
 
     int getMainsVoltage() { return MainsVoltage.getValue(); }
     void setMainsVoltageCallback(void (*callback)(int)) { MainsVoltage.setCallback(callback); }
@@ -894,10 +985,10 @@ public:
     void setSpaTimeCallback(void (*callback)(time_t)) { SpaTime.setCallback(callback); }
     
 
-    /// @brief Get current heater temperature multiplied by 10 (245 = 24.5 actual)
+    /// @brief Get current heater temperature ('C) to one decimal (24.5)
     /// @return 
-    int getHeaterTemperature() { return HeaterTemperature.getValue(); }
-    void setHeaterTemperatureCallback(void (*callback)(int)) { HeaterTemperature.setCallback(callback); }
+    FixedPoint<1> getHeaterTemperature() { return HeaterTemperature.getValue(); }
+    void setHeaterTemperatureCallback(void (*callback)(FixedPoint<1>)) { HeaterTemperature.setCallback(callback); }
 
     int getPoolTemperature() { return PoolTemperature.getValue(); }
     void setPoolTemperatureCallback(void (*callback)(int)) { PoolTemperature.setCallback(callback); }
@@ -1025,7 +1116,7 @@ public:
 
     String getMode() { return Mode.getValue(); }
     void setModeCallback(void (*callback)(String)) { Mode.setCallback(callback); }
-    const std::array <String, 4> spaModeStrings = {"NORM","ECON", "AWAY","WEEK"};
+    static constexpr std::array<const char*, 4> spaModeStrings = {{"NORM","ECON", "AWAY","WEEK"}};
 
     int getSer1_Timer() { return Ser1_Timer.getValue(); }
     void setSer1_TimerCallback(void (*callback)(int)) { Ser1_Timer.setCallback(callback); }
@@ -1055,15 +1146,15 @@ public:
     int getAdtHeaterHys() { return AdtHeaterHys.getValue(); }
     void setAdtHeaterHysCallback(void (*callback)(int)) { AdtHeaterHys.setCallback(callback); }
 
-    /// @brief Get current power consumption (W) multiplied by 10 (24350 = 2435.0)
+    /// @brief Get current power consumption (W) to one decimal (2435.0)
     /// @return 
-    int getPower() { return Power.getValue(); }
-    void setPowerCallback(void (*callback)(int)) { Power.setCallback(callback); }
+    FixedPoint<1> getPower() { return Power.getValue(); }
+    void setPowerCallback(void (*callback)(FixedPoint<1>)) { Power.setCallback(callback); }
 
-    /// @brief Get energy consumption since last reset (kWh) multiplied by 100 (24350 = 243.50)
+    /// @brief Get energy consumption since last reset (kWh) to two decimals (243.50)
     /// @return 
-    int getPower_kWh() { return Power_kWh.getValue(); }
-    void setPower_kWhCallback(void (*callback)(int)) { Power_kWh.setCallback(callback); }
+    FixedPoint<2> getPower_kWh() { return Power_kWh.getValue(); }
+    void setPower_kWhCallback(void (*callback)(FixedPoint<2>)) { Power_kWh.setCallback(callback); }
 
     /// @brief Get energy consumption today (kWh) multiplied by 100 (24350 = 243.50)
     /// @return 
@@ -1131,11 +1222,13 @@ public:
 
     int getRB_TP_Pump5() { return RB_TP_Pump5.getValue(); }
     void setRB_TP_Pump5Callback(void (*callback)(int)) { RB_TP_Pump5.setCallback(callback); }
-    const std::array<String, 2> autoPumpOptions = {"Manual", "Auto"};
+    static constexpr std::array<const char*, 2> autoPumpOptions = {{"Manual", "Auto"}};
+    /// @brief Names of the PumpCapabilities::STATE_ values
+    static constexpr std::array<const char*, 5> pumpStateStrings = {{"OFF", "ON", "LOW", "HIGH", "AUTO"}};
 
     int getRB_TP_Blower() { return RB_TP_Blower.getValue(); }
     void setRB_TP_BlowerCallback(void (*callback)(int)) { RB_TP_Blower.setCallback(callback); }
-    const std::array <String, 2> blowerStrings = {"Variable", "Ramp"};
+    static constexpr std::array<const char*, 2> blowerStrings = {{"Variable", "Ramp"}};
 
     int getRB_TP_Light() { return RB_TP_Light.getValue(); }
     void setRB_TP_LightCallback(void (*callback)(int)) { RB_TP_Light.setCallback(callback); }
@@ -1152,10 +1245,10 @@ public:
     bool getRB_TP_Sleep() { return RB_TP_Sleep.getValue(); }
     void setRB_TP_SleepCallback(void (*callback)(bool)) { RB_TP_Sleep.setCallback(callback); }
 
-    /// @brief Get current water temperature divide by 10 to get actual temp (384 = 38.4 )
+    /// @brief Get current water temperature ('C) to one decimal (38.4)
     /// @return 
-    int getWTMP() { return WTMP.getValue(); }
-    void setWTMPCallback(void (*callback)(int)) { WTMP.setCallback(callback); }
+    FixedPoint<1> getWTMP() { return WTMP.getValue(); }
+    void setWTMPCallback(void (*callback)(FixedPoint<1>)) { WTMP.setCallback(callback); }
 
     bool getCleanCycle() { return CleanCycle.getValue(); }
     void setCleanCycleCallback(void (*callback)(bool)) { CleanCycle.setCallback(callback); }
@@ -1168,15 +1261,15 @@ public:
 
     int getCurrClr() { return CurrClr.getValue(); }
     void setCurrClrCallback(void (*callback)(int)) { CurrClr.setCallback(callback); }
-    const std::array <int, 25> colorMap = {0, 4, 4, 19, 13, 25, 25, 16, 10, 7, 2, 8, 5, 3, 6, 6, 21, 21, 21, 18, 18, 9, 9, 1, 1};
+    static constexpr std::array<int, 25> colorMap = {{0, 4, 4, 19, 13, 25, 25, 16, 10, 7, 2, 8, 5, 3, 6, 6, 21, 21, 21, 18, 18, 9, 9, 1, 1}};
 
     int getColorMode() { return ColorMode.getValue(); }
     void setColorModeCallback(void (*callback)(int)) { ColorMode.setCallback(callback); }
-    const std::array <String, 5> colorModeStrings = {"White","Color","Fade","Step","Party"};
+    static constexpr std::array<const char*, 5> colorModeStrings = {{"White","Color","Fade","Step","Party"}};
 
     int getLSPDValue() { return LSPDValue.getValue(); }
     void setLSPDValueCallback(void (*callback)(int)) { LSPDValue.setCallback(callback); }
-    const std::array <String, 5> lightSpeedMap = {"1","2","3","4","5"};
+    static constexpr std::array<const char*, 5> lightSpeedMap = {{"1","2","3","4","5"}};
 
     int getFiltSetHrs() { return FiltSetHrs.getValue(); }
     void setFiltSetHrsCallback(void (*callback)(int)) { FiltSetHrs.setCallback(callback); }
@@ -1184,10 +1277,10 @@ public:
     int getFiltBlockHrs() { return FiltBlockHrs.getValue(); }
     void setFiltBlockHrsCallback(void (*callback)(int)) { FiltBlockHrs.setCallback(callback); }
 
-    /// @brief Get water temperature setpoint divide by 10 to get actual temp (384 = 38.4 )
+    /// @brief Get water temperature setpoint ('C) to one decimal (38.4)
     /// @return 
-    int getSTMP() { return STMP.getValue(); }
-    void setSTMPCallback(void (*callback)(int)) { STMP.setCallback(callback); }
+    FixedPoint<1> getSTMP() { return STMP.getValue(); }
+    void setSTMPCallback(void (*callback)(FixedPoint<1>)) { STMP.setCallback(callback); }
 
     int getL_24HOURS() { return L_24HOURS.getValue(); }
     void setL_24HOURSCallback(void (*callback)(int)) { L_24HOURS.setCallback(callback); }
@@ -1203,8 +1296,8 @@ public:
 
     int getL_1SNZ_DAY() { return L_1SNZ_DAY.getValue(); }
     void setL_1SNZ_DAYCallback(void (*callback)(int)) { L_1SNZ_DAY.setCallback(callback); }
-    const std::array <String, 11> sleepSelection = {"Off", "Everyday", "Weekends", "Weekdays", "Monday", "Tuesday", "Wednesday", "Thuesday", "Friday", "Saturday", "Sunday"};
-    const std::array <byte, 11> sleepBitmap = {128, 127, 96, 31, 16, 8, 4, 2, 1, 64, 32}; 
+    static constexpr std::array<const char*, 11> sleepSelection = {{"Off", "Everyday", "Weekends", "Weekdays", "Monday", "Tuesday", "Wednesday", "Thuesday", "Friday", "Saturday", "Sunday"}};
+    static constexpr std::array<byte, 11> sleepBitmap = {{128, 127, 96, 31, 16, 8, 4, 2, 1, 64, 32}};
 
     int getL_2SNZ_DAY() { return L_2SNZ_DAY.getValue(); }
     void setL_2SNZ_DAYCallback(void (*callback)(int)) { L_2SNZ_DAY.setCallback(callback); }
@@ -1316,7 +1409,7 @@ public:
 
     int getHPMP() { return HPMP.getValue(); }
     void setHPMPCallback(void (*callback)(int)) { HPMP.setCallback(callback); }
-    const std::array <String, 4> HPMPStrings = {"Auto","Heat","Cool","Off"};
+    static constexpr std::array<const char*, 4> HPMPStrings = {{"Auto","Heat","Cool","Off"}};
 
     int getPMIN() { return PMIN.getValue(); }
     void setPMINCallback(void (*callback)(int)) { PMIN.setCallback(callback); }
@@ -1560,6 +1653,30 @@ public:
 
     int getLockMode() { return LockMode.getValue(); }
     void setLockModeCallback(void (*callback)(int)) { LockMode.setCallback(callback); }
+
+    /// @brief Set the number of readings the rolling statistics are calculated over.
+    /// @param window 2 - RollingStatistics::maxWindow
+    void setStatisticsWindow(uint8_t window);
+
+    const RollingStatistics& getWTMPStatistics() const { return WTMPStatistics; }
+    const RollingStatistics& getHeaterTemperatureStatistics() const { return HeaterTemperatureStatistics; }
+    const RollingStatistics& getCaseTemperatureStatistics() const { return CaseTemperatureStatistics; }
+    const RollingStatistics& getMainsVoltageStatistics() const { return MainsVoltageStatistics; }
+    const RollingStatistics& getMainsCurrentStatistics() const { return MainsCurrentStatistics; }
+    const RollingStatistics& getPowerStatistics() const { return PowerStatistics; }
+
+    /// @brief Report the current value of every property, see PropertyVisitor.
+    void visitProperties(PropertyVisitor &visitor);
+
+    /// @brief Decoded install state of a pump.
+    /// @param pumpNumber 1 - 5, other values return a pump that is not installed
+    const PumpCapabilities& getPumpCapabilities(int pumpNumber) const;
+
+    /// @brief Capability bit for HP_Present.
+    static const uint8_t CAPABILITY_HEAT_PUMP = 0x01;
+    /// @brief Capability bit for a pump install state.
+    /// @param pumpNumber 1 - 5
+    static constexpr uint8_t capabilityPump(int pumpNumber) { return 1 << pumpNumber; }
 };
 
 #endif
\ No newline at end of file
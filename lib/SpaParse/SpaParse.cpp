@@ -0,0 +1,71 @@
+#include "SpaParse.h"
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+
+bool parseInt(StringView s, int &value) {
+  size_t i = 0;
+  bool negative = s.length > 0 && s.data[0] == '-';
+  if (s.length > 0 && (s.data[0] == '-' || s.data[0] == '+')) i++;
+  if (i == s.length) return false;
+
+  int64_t result = 0;
+  for (; i < s.length; i++) {
+    if (!isdigit(s.data[i])) return false;
+    result = result * 10 + (s.data[i] - '0');
+    if (result > INT_MAX) return false;
+  }
+  value = negative ? -result : result;
+  return true;
+}
+
+/// @brief Digits at a fixed position, for the datetime fields.
+static bool parseDigits(StringView s, size_t start, size_t count, int &value) {
+  return start + count <= s.length && parseInt(StringView{s.data + start, count}, value) && isdigit(s.data[start]);
+}
+
+bool parseTimeOfDay(StringView s, int &value) {
+  const char *colon = (const char *)memchr(s.data, ':', s.length);
+  if (colon == nullptr) return false;
+
+  size_t hoursLength = colon - s.data;
+  int hours, minutes;
+  if (hoursLength < 1 || hoursLength > 2 || !parseDigits(s, 0, hoursLength, hours)) return false;
+  size_t minutesLength = s.length - hoursLength - 1;
+  if (minutesLength < 1 || minutesLength > 2 || !parseDigits(s, hoursLength + 1, minutesLength, minutes)) return false;
+  if (hours >= 24 || minutes >= 60) return false;
+
+  value = (hours * 256) + minutes;
+  return true;
+}
+
+/// @brief Days from 1970-01-01 to a date of the proleptic Gregorian calendar.
+static long daysFromCivil(int year, int month, int day) {
+  year -= month <= 2;
+  long era = (year >= 0 ? year : year - 399) / 400;
+  long yearOfEra = year - era * 400;
+  long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+static int daysInMonth(int year, int month) {
+  static const uint8_t days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+  return month == 2 && leap ? 29 : days[month - 1];
+}
+
+bool parseDateTime(StringView s, time_t &value) {
+  int year, month, day, hour, minute, second = 0;
+  if (s.length != 16 && s.length != 19) return false;
+  if (!parseDigits(s, 0, 4, year) || !parseDigits(s, 5, 2, month) || !parseDigits(s, 8, 2, day)
+      || !parseDigits(s, 11, 2, hour) || !parseDigits(s, 14, 2, minute)) return false;
+  if (s.data[4] != '-' || s.data[7] != '-' || (s.data[10] != ' ' && s.data[10] != 'T') || s.data[13] != ':') return false;
+  if (s.length == 19 && (s.data[16] != ':' || !parseDigits(s, 17, 2, second))) return false;
+  // The spa clock, like TimeLib, counts from 1970 and can not go past 2105
+  if (year < 1970 || year > 2105 || month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month)
+      || hour >= 24 || minute >= 60 || second >= 60) return false;
+
+  value = (time_t)((int64_t)daysFromCivil(year, month, day) * 86400 + hour * 3600L + minute * 60L + second);
+  return true;
+}
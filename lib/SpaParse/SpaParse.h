@@ -0,0 +1,28 @@
+#ifndef SPAPARSE_H
+#define SPAPARSE_H
+
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+/// @brief Characters that are not NUL terminated, eg an MQTT payload left in the client's buffer.
+struct StringView {
+  const char *data;
+  size_t length;
+
+  bool operator==(const char *s) const { return strlen(s) == length && memcmp(data, s, length) == 0; }
+  bool operator!=(const char *s) const { return !(*this == s); }
+};
+
+/// @brief Parse a decimal integer, an optional sign then digits only.
+bool parseInt(StringView s, int &value);
+
+/// @brief Parse a time of day "HH:MM" into the controller's HH * 256 + MM.
+bool parseTimeOfDay(StringView s, int &value);
+
+/// @brief Parse "YYYY-MM-DD HH:MM:SS" (or with a T, seconds are optional), nothing may follow.
+///
+/// The result counts seconds from 1970 without any time zone, like TimeLib's makeTime.
+bool parseDateTime(StringView s, time_t &value);
+
+#endif // SPAPARSE_H
@@ -15,71 +15,38 @@ String convertToTime(int data) {
   return timeStr;
 }
 
-int convertToInteger(String &timeStr) {
-  int data = -1;
-
-  // Check for an empty string
-  if (timeStr.length() == 0) {
-    return data;
-  }
-
-  // Find the position of the colon
-  int colonIndex = timeStr.indexOf(':');
-  if (colonIndex == -1) {
-    return data; // Invalid format
+// 32 bit FNV-1a, used to spot changed payloads without keeping them
+uint32_t fnv1a(const char *data, size_t length, uint32_t hash) {
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (uint8_t)data[i]) * 16777619u;
   }
-
-  // Extract hours and minutes as substrings
-  int hours = timeStr.substring(0, colonIndex).toInt();
-  int minutes = timeStr.substring(colonIndex + 1).toInt();
-
-  // Validate hours and minutes ranges
-  if (hours >= 0 && hours < 24 && minutes >= 0 && minutes < 60) {
-    data = (hours * 256) + minutes;
-  }
-
-  // Print debug information
-  debugV("data: %i, timeStr: %s", data, timeStr.c_str());
-
-  return data;
+  return hash;
 }
 
-bool getPumpModesJson(SpaInterface &si, int pumpNumber, JsonObject pumps) {
+bool getPumpModesJson(SpaInterface &si, const SpaStatusSnapshot &snapshot, int pumpNumber, JsonObject pumps) {
   // Validate the pump number
   if (pumpNumber < 1 || pumpNumber > 5) {
     return false;
   }
 
-  // Retrieve the pump install state dynamically
-  String pumpInstallState = (si.*(pumpInstallStateFunctions[pumpNumber - 1]))();
+  const PumpCapabilities &pump = si.getPumpCapabilities(pumpNumber);
 
   char pumpKey[6] = "pump";  // Start with "pump"
   pumpKey[4] = '0' + pumpNumber;  // Append the pump number as a character
   pumpKey[5] = '\0';  // Null-terminate the string
 
-  pumps[pumpKey]["installed"] = getPumpInstalledState(pumpInstallState);
-  String speedType = getPumpSpeedType(pumpInstallState);
+  pumps[pumpKey]["installed"] = pump.installed;
+  char speedType[4];
+  snprintf(speedType, sizeof(speedType), "%u", pump.speedType);
   pumps[pumpKey]["speedType"] = speedType;
 
-  String possibleStates = getPumpPossibleStates(pumpInstallState);
-  // Convert possibleStates into words and store them in a JSON array
-  for (uint i = 0; i < possibleStates.length(); i++) {
-    char stateChar = possibleStates.charAt(i);
-    if (stateChar == '0') {
-      pumps[pumpKey]["possibleStates"].add("OFF");
-    } else if (stateChar == '1') {
-      pumps[pumpKey]["possibleStates"].add("ON");
-    } else if (stateChar == '2') {
-      pumps[pumpKey]["possibleStates"].add("LOW");
-    } else if (stateChar == '3') {
-      pumps[pumpKey]["possibleStates"].add("HIGH");
-    } else if (stateChar == '4') {
-      pumps[pumpKey]["possibleStates"].add("AUTO");
-    }
+  // Possible states as words, in state order
+  for (uint8_t state = 0; state < si.pumpStateStrings.size(); state++) {
+    if (pump.supports(state)) pumps[pumpKey]["possibleStates"].add(si.pumpStateStrings[state]);
   }
 
-  int pumpState = (si.*(pumpStateFunctions[pumpNumber - 1]))();
-  if (pumpInstallState.endsWith("4") && possibleStates.length() > 1) {
+  int pumpState = snapshot.RB_TP_Pump[pumpNumber - 1];
+  if (pump.supports(PumpCapabilities::STATE_AUTO) && pump.stateCount() > 1) {
     if (pumpState == 4) pumps[pumpKey]["mode"] = "Auto";
     else pumps[pumpKey]["mode"] = "Manual";
   }
@@ -90,59 +57,42 @@ bool getPumpModesJson(SpaInterface &si, int pumpNumber, JsonObject pumps) {
   return true;
 }
 
-bool getPumpInstalledState(String pumpInstallState) {
-  return pumpInstallState.startsWith("1");
-}
-
-String getPumpSpeedType(String pumpInstallState) {
-  int firstDash = pumpInstallState.indexOf("-");
-  int secondDash = pumpInstallState.lastIndexOf("-");
-  return pumpInstallState.substring(firstDash + 1, secondDash);
-}
-
-String getPumpPossibleStates(String pumpInstallState) {
-  int secondDash = pumpInstallState.lastIndexOf("-");
-  return pumpInstallState.substring(secondDash + 1);
-}
-
-int getPumpSpeedMax(String pumpInstallState) {
-  String possibleStates = getPumpPossibleStates(pumpInstallState);
-  uint max = 0;
-  for (uint i = 0; i < possibleStates.length(); i++) {
-    int pumpMode = possibleStates.charAt(i)  - '0';
-    if (pumpMode > 0 && pumpMode < 4 && pumpMode > max) max = pumpMode;
-  }
-  return max;
-}
+void getStatisticsJson(const RollingStatistics &stats, float divisor, JsonObject json) {
+  if (stats.getCount() == 0) return;
 
-int getPumpSpeedMin(String pumpInstallState) {
-  String possibleStates = getPumpPossibleStates(pumpInstallState);
-  uint min = UINT_MAX;
-  for (uint i = 0; i < possibleStates.length(); i++) {
-    int pumpMode = possibleStates.charAt(i)  - '0';
-    if (pumpMode > 0 && pumpMode < 4 && pumpMode < min) min = pumpMode;
-  }
-  if (min == UINT_MAX) min = 0;
-  return min;
+  json["min"] = stats.getMin() / divisor;
+  json["max"] = stats.getMax() / divisor;
+  json["mean"] = round(stats.getMean() / divisor * 100) / 100.0;
+  json["ewma"] = round(stats.getEWMA() / divisor * 100) / 100.0;
 }
 
-bool generateStatusJson(SpaInterface &si, MQTTClientWrapper &mqttClient, String &output, bool prettyJson) {
-  JsonDocument json;
-
-  json["temperatures"]["setPoint"] = si.getSTMP() / 10.0;
-  json["temperatures"]["water"] = si.getWTMP() / 10.0;
-  json["temperatures"]["heater"] = si.getHeaterTemperature() / 10.0;
-  json["temperatures"]["case"] = si.getCaseTemperature(); 
-  json["temperatures"]["heatpumpAmbient"] = si.getHP_Ambient();
-  json["temperatures"]["heatpumpCondensor"] = si.getHP_Condensor();
-
-  json["power"]["voltage"] = si.getMainsVoltage();
-  json["power"]["current"]= si.getMainsCurrent() / 10.0; // convert value to A
-  json["power"]["power"] = si.getPower() / 10.0; // convert value to W
-  json["power"]["totalenergy"]= si.getPower_kWh() / 100.0; // convert value to kWh.
-
-  json["status"]["heatingActive"] = si.getRB_TP_Heater()? "ON": "OFF";
-  json["status"]["ozoneActive"] = si.getRB_TP_Ozone()? "ON": "OFF";
+bool generateStatusJson(SpaInterface &si, MQTTClientWrapper &mqttClient, JsonDocument &json) {
+  // Numeric values come from a single coherent RF frame, the strings are read directly.
+  SpaStatusSnapshot snapshot;
+  si.getSnapshot(snapshot);
+
+  setFixedPointJson(json["temperatures"]["setPoint"], snapshot.STMP);
+  setFixedPointJson(json["temperatures"]["water"], snapshot.WTMP);
+  setFixedPointJson(json["temperatures"]["heater"], snapshot.HeaterTemperature);
+  json["temperatures"]["case"] = snapshot.CaseTemperature;
+  json["temperatures"]["heatpumpAmbient"] = snapshot.HP_Ambient;
+  json["temperatures"]["heatpumpCondensor"] = snapshot.HP_Condensor;
+
+  json["power"]["voltage"] = snapshot.MainsVoltage;
+  setFixedPointJson(json["power"]["current"], snapshot.MainsCurrent); // A
+  setFixedPointJson(json["power"]["power"], snapshot.Power); // W
+  setFixedPointJson(json["power"]["totalenergy"], snapshot.Power_kWh); // kWh
+
+  // Rolling min / max / mean / ewma over the last StatisticsWindow readings, same units as above.
+  getStatisticsJson(si.getWTMPStatistics(), 10.0, json["stats"]["water"].to<JsonObject>());
+  getStatisticsJson(si.getHeaterTemperatureStatistics(), 10.0, json["stats"]["heater"].to<JsonObject>());
+  getStatisticsJson(si.getCaseTemperatureStatistics(), 1, json["stats"]["case"].to<JsonObject>());
+  getStatisticsJson(si.getMainsVoltageStatistics(), 1, json["stats"]["voltage"].to<JsonObject>());
+  getStatisticsJson(si.getMainsCurrentStatistics(), 10.0, json["stats"]["current"].to<JsonObject>());
+  getStatisticsJson(si.getPowerStatistics(), 10.0, json["stats"]["power"].to<JsonObject>());
+
+  json["status"]["heatingActive"] = snapshot.RB_TP_Heater? "ON": "OFF";
+  json["status"]["ozoneActive"] = snapshot.RB_TP_Ozone? "ON": "OFF";
   json["status"]["state"] = si.getStatus();
   json["status"]["spaMode"] = si.getMode();
   json["status"]["controller"] = si.getModel();
@@ -150,65 +100,63 @@ bool generateStatusJson(SpaInterface &si, MQTTClientWrapper &mqttClient, String
   json["status"]["siInitialised"] = si.isInitialised()?"true":"false";
   json["status"]["mqtt"] = mqttClient.connected()?"connected":"disconnected";
 
-  json["heatpump"]["mode"] = si.HPMPStrings[si.getHPMP()];
-  json["heatpump"]["auxheat"] = si.getHELE()==0? "OFF" : "ON";
+  json["heatpump"]["mode"] = lookupString(si.HPMPStrings, snapshot.HPMP);
+  json["heatpump"]["auxheat"] = snapshot.HELE==0? "OFF" : "ON";
 
   JsonObject pumps = json["pumps"].to<JsonObject>();
   // Add pump data by calling the function for each pump
   for (int i = 1; i <= 5; i++) {
-    if (!getPumpModesJson(si, i, pumps)) {
+    if (!getPumpModesJson(si, snapshot, i, pumps)) {
       debugD("Invalid pump number: %i", i);
     }
   }
 
-  String y=String(year(si.getSpaTime()));
-  String m=String(month(si.getSpaTime()));
-  if (month(si.getSpaTime())<10) m = "0"+m;
-  String d=String(day(si.getSpaTime()));
-  if (day(si.getSpaTime())<10) d = "0"+d;
-  String h=String(hour(si.getSpaTime()));
-  if (hour(si.getSpaTime())<10) h = "0"+h;
-  String min=String(minute(si.getSpaTime()));
-  if (minute(si.getSpaTime())<10) min = "0"+min;
-  String s=String(second(si.getSpaTime()));
-  if (second(si.getSpaTime())<10) s = "0"+s;
+  String y=String(year(snapshot.SpaTime));
+  String m=String(month(snapshot.SpaTime));
+  if (month(snapshot.SpaTime)<10) m = "0"+m;
+  String d=String(day(snapshot.SpaTime));
+  if (day(snapshot.SpaTime)<10) d = "0"+d;
+  String h=String(hour(snapshot.SpaTime));
+  if (hour(snapshot.SpaTime)<10) h = "0"+h;
+  String min=String(minute(snapshot.SpaTime));
+  if (minute(snapshot.SpaTime)<10) min = "0"+min;
+  String s=String(second(snapshot.SpaTime));
+  if (second(snapshot.SpaTime)<10) s = "0"+s;
 
   json["status"]["datetime"]=y+"-"+m+"-"+d+" "+h+":"+min+":"+s;
 
-  json["blower"]["state"] = si.getOutlet_Blower()==2? "OFF" : "ON";
-  json["blower"]["mode"] = si.getOutlet_Blower()==1? "Ramp" : "Variable";
-  json["blower"]["speed"] = si.getOutlet_Blower() ==2? "0" : String(si.getVARIValue());
+  json["blower"]["state"] = snapshot.Outlet_Blower==2? "OFF" : "ON";
+  json["blower"]["mode"] = snapshot.Outlet_Blower==1? "Ramp" : "Variable";
+  json["blower"]["speed"] = snapshot.Outlet_Blower ==2? "0" : String(snapshot.VARIValue);
 
-  int member = 0;
-  for (const auto& pair : si.sleepBitmap) {
-      if (pair == si.getL_1SNZ_DAY()) {
-        json["sleepTimers"]["timer1"]["state"]=si.sleepSelection[member];
-        debugD("SleepTimer1: %s", si.sleepSelection[member].c_str());
-      }
-      if (pair == si.getL_2SNZ_DAY()) {
-        json["sleepTimers"]["timer2"]["state"]=si.sleepSelection[member];
-        debugD("SleepTimer2: %s", si.sleepSelection[member].c_str());
-      }
-      member++;
+  int member = lookupIndex(si.sleepBitmap, snapshot.L_1SNZ_DAY);
+  if (member >= 0) {
+    json["sleepTimers"]["timer1"]["state"]=si.sleepSelection[member];
+    debugD("SleepTimer1: %s", si.sleepSelection[member]);
+  }
+  member = lookupIndex(si.sleepBitmap, snapshot.L_2SNZ_DAY);
+  if (member >= 0) {
+    json["sleepTimers"]["timer2"]["state"]=si.sleepSelection[member];
+    debugD("SleepTimer2: %s", si.sleepSelection[member]);
   }
-  json["sleepTimers"]["timer1"]["begin"]=convertToTime(si.getL_1SNZ_BGN());
-  json["sleepTimers"]["timer1"]["end"]=convertToTime(si.getL_1SNZ_END());
-  json["sleepTimers"]["timer2"]["begin"]=convertToTime(si.getL_2SNZ_BGN());
-  json["sleepTimers"]["timer2"]["end"]=convertToTime(si.getL_2SNZ_END());
+  json["sleepTimers"]["timer1"]["begin"]=convertToTime(snapshot.L_1SNZ_BGN);
+  json["sleepTimers"]["timer1"]["end"]=convertToTime(snapshot.L_1SNZ_END);
+  json["sleepTimers"]["timer2"]["begin"]=convertToTime(snapshot.L_2SNZ_BGN);
+  json["sleepTimers"]["timer2"]["end"]=convertToTime(snapshot.L_2SNZ_END);
 
-  json["lights"]["speed"] = si.getLSPDValue();
-  json["lights"]["state"] = si.getRB_TP_Light()? "ON": "OFF";
-  json["lights"]["effect"] = si.colorModeStrings[si.getColorMode()];
-  json["lights"]["brightness"] = si.getLBRTValue();
+  json["lights"]["speed"] = snapshot.LSPDValue;
+  json["lights"]["state"] = snapshot.RB_TP_Light? "ON": "OFF";
+  json["lights"]["effect"] = lookupString(si.colorModeStrings, snapshot.ColorMode);
+  json["lights"]["brightness"] = snapshot.LBRTValue;
 
   // 0 = white, if white, then set the hue and saturation to white so the light displays correctly in HA.
-  if (si.getColorMode() == 0) {
+  if (snapshot.ColorMode == 0) {
     json["lights"]["color"]["h"] = 0;
     json["lights"]["color"]["s"] = 0;
   } else {
     int hue = 4;
-    for (uint count = 0; count < sizeof(si.colorMap); count++){
-      if (si.colorMap[count] == si.getCurrClr()) {
+    for (uint count = 0; count < si.colorMap.size(); count++){
+      if (si.colorMap[count] == snapshot.CurrClr) {
         hue = count * 15;
       }
     }
@@ -217,6 +165,13 @@ bool generateStatusJson(SpaInterface &si, MQTTClientWrapper &mqttClient, String
   }
   json["lights"]["color_mode"] = "hs";
 
+  return !json.overflowed();
+}
+
+bool generateStatusJson(SpaInterface &si, MQTTClientWrapper &mqttClient, String &output, bool prettyJson) {
+  JsonDocument json;
+  if (!generateStatusJson(si, mqttClient, json)) return false;
+
   int jsonSize;
   if (prettyJson) {
     jsonSize = serializeJsonPretty(json, output);
@@ -227,3 +182,309 @@ bool generateStatusJson(SpaInterface &si, MQTTClientWrapper &mqttClient, String
   return (jsonSize > 0);
 }
 
+void PropertyJsonWriter::writeKey(const char *name) {
+  if (!_first) _out.write(',');
+  _first = false;
+  writeString(name);
+  _out.write(':');
+}
+
+void PropertyJsonWriter::writeString(const char *value) {
+  _out.write('"');
+  for (const char *c = value; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      _out.write('\\');
+      _out.write(*c);
+    } else if ((uint8_t)*c < 0x20) {
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+      _out.write(escaped);
+    } else {
+      _out.write(*c);
+    }
+  }
+  _out.write('"');
+}
+
+void PrometheusWriter::family(const char *name, const char *type, const char *help) {
+  _out.printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void PrometheusWriter::writeName(const char *name, const char *labels) {
+  _out.print(name);
+  if (labels != nullptr) {
+    _out.write('{');
+    _out.print(labels);
+    _out.write('}');
+  }
+  _out.write(' ');
+}
+
+void PrometheusWriter::sample(const char *name, const char *labels, long value) {
+  writeName(name, labels);
+  _out.print(value);
+  _out.write('\n');
+}
+
+void PrometheusWriter::sample(const char *name, const char *labels, unsigned long value) {
+  writeName(name, labels);
+  _out.print(value);
+  _out.write('\n');
+}
+
+void PrometheusWriter::sample(const char *name, const char *labels, double value) {
+  writeName(name, labels);
+  _out.print(value, 6);
+  _out.write('\n');
+}
+
+void writeMetrics(SpaInterface &si, MQTTClientWrapper &mqttClient, const RuntimeStatistics &stats, Print &out) {
+  PrometheusWriter metrics(out);
+  SpaStatusSnapshot snapshot;
+  si.getSnapshot(snapshot);
+
+  if (si.isInitialised()) {
+    metrics.family("spa_temperature_celsius", "gauge", "Temperatures reported by the spa controller.");
+    metrics.sample("spa_temperature_celsius", "sensor=\"water\"", snapshot.WTMP);
+    metrics.sample("spa_temperature_celsius", "sensor=\"set_point\"", snapshot.STMP);
+    metrics.sample("spa_temperature_celsius", "sensor=\"heater\"", snapshot.HeaterTemperature);
+    metrics.sample("spa_temperature_celsius", "sensor=\"case\"", (long)snapshot.CaseTemperature);
+    metrics.sample("spa_temperature_celsius", "sensor=\"heatpump_ambient\"", (long)snapshot.HP_Ambient);
+    metrics.sample("spa_temperature_celsius", "sensor=\"heatpump_condenser\"", (long)snapshot.HP_Condensor);
+
+    metrics.family("spa_mains_voltage_volts", "gauge", "Mains voltage.");
+    metrics.sample("spa_mains_voltage_volts", nullptr, (long)snapshot.MainsVoltage);
+    metrics.family("spa_mains_current_amperes", "gauge", "Mains current draw.");
+    metrics.sample("spa_mains_current_amperes", nullptr, snapshot.MainsCurrent);
+    metrics.family("spa_power_watts", "gauge", "Power draw.");
+    metrics.sample("spa_power_watts", nullptr, snapshot.Power);
+    metrics.family("spa_energy_kilowatt_hours_total", "counter", "Energy used as counted by the controller.");
+    metrics.sample("spa_energy_kilowatt_hours_total", nullptr, snapshot.Power_kWh);
+
+    metrics.family("spa_heater_active", "gauge", "1 while the heater is running.");
+    metrics.sample("spa_heater_active", nullptr, (long)snapshot.RB_TP_Heater);
+    metrics.family("spa_aux_heater_enabled", "gauge", "1 if the heat pump aux element is enabled.");
+    metrics.sample("spa_aux_heater_enabled", nullptr, (long)snapshot.HELE);
+    metrics.family("spa_ozone_active", "gauge", "1 while the ozone generator is running.");
+    metrics.sample("spa_ozone_active", nullptr, (long)snapshot.RB_TP_Ozone);
+
+    metrics.family("spa_pump_state", "gauge", "Pump state (0 off, 1 on, 2 low, 3 high, 4 auto), installed pumps only.");
+    char labels[12];
+    for (int pump = 1; pump <= 5; pump++) {
+      if (!si.getPumpCapabilities(pump).installed) continue;
+      snprintf(labels, sizeof(labels), "pump=\"%i\"", pump);
+      metrics.sample("spa_pump_state", labels, (long)snapshot.RB_TP_Pump[pump - 1]);
+    }
+
+    metrics.family("spa_blower_speed", "gauge", "Blower speed (1 - 5), 0 when off.");
+    metrics.sample("spa_blower_speed", nullptr, (long)(snapshot.Outlet_Blower == 2 ? 0 : snapshot.VARIValue));
+    metrics.family("spa_light_on", "gauge", "1 while the lights are on.");
+    metrics.sample("spa_light_on", nullptr, (long)snapshot.RB_TP_Light);
+    metrics.family("spa_light_brightness", "gauge", "Light brightness (1 - 5).");
+    metrics.sample("spa_light_brightness", nullptr, (long)snapshot.LBRTValue);
+  }
+
+  metrics.family("spa_status_reads_total", "counter", "RF status reads attempted.");
+  metrics.sample("spa_status_reads_total", nullptr, (unsigned long)si.getStatusReadCount());
+  metrics.family("spa_status_read_errors_total", "counter", "RF status reads that were incomplete or corrupted.");
+  metrics.sample("spa_status_read_errors_total", nullptr, (unsigned long)si.getStatusReadErrorCount());
+  metrics.family("spa_command_errors_total", "counter", "Commands not acknowledged by the controller.");
+  metrics.sample("spa_command_errors_total", nullptr, (unsigned long)si.getCommandErrorCount());
+
+  metrics.family("sn_esp32_uptime_seconds", "gauge", "Time since boot.");
+  metrics.sample("sn_esp32_uptime_seconds", nullptr, (unsigned long)((millis() - stats.bootMillis) / 1000));
+  metrics.family("sn_esp32_heap_free_bytes", "gauge", "Free heap.");
+  metrics.sample("sn_esp32_heap_free_bytes", nullptr, (unsigned long)ESP.getFreeHeap());
+  metrics.family("sn_esp32_heap_min_free_bytes", "gauge", "Lowest free heap since boot.");
+  metrics.sample("sn_esp32_heap_min_free_bytes", nullptr, (unsigned long)ESP.getMinFreeHeap());
+  metrics.family("sn_esp32_heap_max_alloc_bytes", "gauge", "Largest block that can be allocated.");
+  metrics.sample("sn_esp32_heap_max_alloc_bytes", nullptr, (unsigned long)ESP.getMaxAllocHeap());
+
+  metrics.family("sn_esp32_loop_duration_seconds", "summary", "Duration of the main loop.");
+  metrics.sample("sn_esp32_loop_duration_seconds_sum", nullptr, stats.loopMicrosSum / 1000000.0);
+  metrics.sample("sn_esp32_loop_duration_seconds_count", nullptr, (unsigned long)stats.loopCount);
+  metrics.family("sn_esp32_loop_duration_max_seconds", "gauge", "Longest main loop since boot.");
+  metrics.sample("sn_esp32_loop_duration_max_seconds", nullptr, stats.loopMicrosMax / 1000000.0);
+
+  metrics.family("sn_esp32_mqtt_connected", "gauge", "1 while connected to the MQTT broker.");
+  metrics.sample("sn_esp32_mqtt_connected", nullptr, (long)mqttClient.connected());
+  metrics.family("sn_esp32_mqtt_connects_total", "counter", "Successful MQTT connections, including reconnects.");
+  metrics.sample("sn_esp32_mqtt_connects_total", nullptr, (unsigned long)stats.mqttConnects);
+  metrics.family("sn_esp32_mqtt_connect_failures_total", "counter", "Failed MQTT connection attempts.");
+  metrics.sample("sn_esp32_mqtt_connect_failures_total", nullptr, (unsigned long)stats.mqttConnectFailures);
+  metrics.family("sn_esp32_discovery_duration_seconds", "gauge", "Duration of the last Home Assistant discovery run.");
+  metrics.sample("sn_esp32_discovery_duration_seconds", nullptr, stats.discoveryMillis / 1000.0);
+  metrics.family("sn_esp32_discovery_bytes", "gauge", "Topic and payload bytes sent by the last Home Assistant discovery run.");
+  metrics.sample("sn_esp32_discovery_bytes", nullptr, (unsigned long)stats.discoveryBytes);
+  metrics.family("sn_esp32_discovery_pending_entities", "gauge", "Entities the running Home Assistant discovery has still to publish.");
+  metrics.sample("sn_esp32_discovery_pending_entities", nullptr, (unsigned long)stats.discoveryPending);
+}
+
+/// @brief Print that only counts, so the benchmark measures encoding rather than a sink.
+class CountingPrint : public Print {
+  public:
+    size_t write(uint8_t) override { count++; return 1; }
+    size_t write(const uint8_t *, size_t size) override { count += size; return size; }
+    size_t count = 0;
+};
+
+void compareStatusEncodings(const JsonDocument &json, JsonObject result, int iterations) {
+  CountingPrint out;
+
+  unsigned long start = micros();
+  for (int i = 0; i < iterations; i++) serializeJson(json, out);
+  unsigned long jsonMicros = micros() - start;
+  size_t jsonBytes = out.count / iterations;
+
+  out.count = 0;
+  start = micros();
+  for (int i = 0; i < iterations; i++) serializeMsgPack(json, out);
+  unsigned long msgPackMicros = micros() - start;
+  size_t msgPackBytes = out.count / iterations;
+
+  result["iterations"] = iterations;
+  result["json"]["bytes"] = jsonBytes;
+  result["json"]["us"] = jsonMicros / iterations;
+  result["msgpack"]["bytes"] = msgPackBytes;
+  result["msgpack"]["us"] = msgPackMicros / iterations;
+
+  debugI("Status encoding: JSON %u bytes %lu us, MessagePack %u bytes %lu us", jsonBytes, jsonMicros / iterations, msgPackBytes, msgPackMicros / iterations);
+}
+
+const String& StatusJsonCache::get() {
+  refresh();
+  return _json;
+}
+
+bool StatusJsonCache::refresh() {
+  uint32_t snapshotVersion = _si.getSnapshotVersion();
+  bool mqttConnected = _mqttClient.connected();
+  if (_valid && snapshotVersion == _snapshotVersion && mqttConnected == _mqttConnected) return true;
+
+  _document.clear();
+  _json = "";
+  _valid = generateStatusJson(_si, _mqttClient, _document) && serializeJson(_document, _json) > 0;
+  if (!_valid) _json = "";
+  _snapshotVersion = snapshotVersion;
+  _mqttConnected = mqttConnected;
+
+  uint32_t hash = fnv1a(_json.c_str(), _json.length());
+  char etag[11];
+  snprintf(etag, sizeof(etag), "\"%08x\"", hash);
+  _etag = etag;
+
+  debugV("Status JSON rebuilt, %u bytes", _json.length());
+  return _valid;
+}
+
+bool applySpaCommand(SpaInterface &si, SpaCommandName command, StringView value) {
+  int pump = command.index;
+  bool validPump = pump >= 1 && pump <= 5;
+  bool validTimer = command.index == 1 || command.index == 2;
+  int number;
+
+  switch (command.command) {
+    case SpaCommand::Unknown:
+      return false;
+    case SpaCommand::SetPoint: {
+      FixedPoint<1> temperature;
+      if (!FixedPoint<1>::parse(value.data, value.length, temperature)) return false;
+      si.setSTMP(temperature.raw());
+      return true;
+    }
+    case SpaCommand::HeatPumpMode:
+      number = lookupIndex(si.HPMPStrings, value);
+      if (number < 0) return false;
+      si.setHPMP(number);
+      return true;
+    case SpaCommand::HeatPumpAuxHeat:
+      si.setHELE(value == "OFF" ? 0 : 1);
+      return true;
+    // note single speed pumps should never trigger a mode or speed events
+    case SpaCommand::PumpSpeed:
+      if (!validPump || !parseInt(value, number)) return false;
+      // value = 1 = Off, value = 2 = Low, value = 3 = High
+      // send values need to be changed to the appropriate values
+      if (number == 1) number = 0;
+      else if (number == 2) number = 3;
+      else if (number == 3) number = 2;
+      (si.*(setPumpFunctions[pump - 1]))(number);
+      return true;
+    case SpaCommand::PumpMode:
+      if (!validPump) return false;
+      if (value == "Auto") (si.*(setPumpFunctions[pump - 1]))(4);
+      else (si.*(setPumpFunctions[pump - 1]))(3); // When we change mode to manual set speed to low, as this matches the auto display speed
+      return true;
+    case SpaCommand::PumpState:
+      if (!validPump) return false;
+      if (si.getPumpCapabilities(pump).speedType == 2) (si.*(setPumpFunctions[pump - 1]))(value == "OFF" ? 0 : 2); // When we turn on the pump use speed high
+      else (si.*(setPumpFunctions[pump - 1]))(value == "OFF" ? 0 : 1);
+      return true;
+    case SpaCommand::DateTime: {
+      time_t time;
+      if (!parseDateTime(value, time)) return false;
+      si.setSpaTime(time);
+      return true;
+    }
+    case SpaCommand::SpaMode:
+      number = lookupIndex(si.spaModeStrings, value);
+      if (number < 0) return false;
+      si.setMode(number);
+      return true;
+    case SpaCommand::LightsState:
+      si.setRB_TP_Light(value == "ON" ? 1 : 0);
+      return true;
+    case SpaCommand::LightsEffect:
+      number = lookupIndex(si.colorModeStrings, value);
+      if (number < 0) return false;
+      si.setColorMode(number);
+      return true;
+    case SpaCommand::LightsBrightness:
+      if (!parseInt(value, number)) return false;
+      si.setLBRTValue(number);
+      return true;
+    case SpaCommand::LightsColor: {
+      // "hue,saturation", the hue picks the nearest controller colour
+      const char *comma = (const char *)memchr(value.data, ',', value.length);
+      if (comma == nullptr || !parseInt(StringView{value.data, (size_t)(comma - value.data)}, number)) return false;
+      if (number < 0 || number / 15 >= (int)si.colorMap.size()) return false;
+      si.setCurrClr(si.colorMap[number / 15]);
+      return true;
+    }
+    case SpaCommand::LightsSpeed:
+      // Same 1 - 5 range as setLSPDValue(String), but where atoi took the leading digits of "3x" this
+      // rejects it, and an out of range speed is now reported as invalid instead of silently ignored.
+      if (!parseInt(value, number) || number < 1 || number > 5) return false;
+      si.setLSPDValue(number);
+      return true;
+    case SpaCommand::BlowerState:
+      si.setOutlet_Blower(value == "OFF" ? 2 : 0);
+      return true;
+    case SpaCommand::BlowerSpeed:
+      if (!parseInt(value, number)) return false;
+      if (number == 0) si.setOutlet_Blower(2);
+      else si.setVARIValue(number);
+      return true;
+    case SpaCommand::BlowerMode:
+      si.setOutlet_Blower(value == "Variable" ? 0 : 1);
+      return true;
+    case SpaCommand::SleepTimerState:
+      if (!validTimer) return false;
+      number = lookupIndex(si.sleepSelection, value);
+      if (number < 0) return false;
+      if (command.index == 1) si.setL_1SNZ_DAY(si.sleepBitmap[number]);
+      else si.setL_2SNZ_DAY(si.sleepBitmap[number]);
+      return true;
+    case SpaCommand::SleepTimerBegin:
+      if (!validTimer || !parseTimeOfDay(value, number)) return false;
+      if (command.index == 1) si.setL_1SNZ_BGN(number);
+      else si.setL_2SNZ_BGN(number);
+      return true;
+    case SpaCommand::SleepTimerEnd:
+      if (!validTimer || !parseTimeOfDay(value, number)) return false;
+      if (command.index == 1) si.setL_1SNZ_END(number);
+      else si.setL_2SNZ_END(number);
+      return true;
+  }
+  return false;
+}
@@ -10,19 +10,189 @@
 #include "Config.h"
 #include <PubSubClient.h>
 #include "MQTTClientWrapper.h"
+#include "SpaCommand.h"
+#include "SpaParse.h"
+#include "StatusDelta.h"
 
 extern RemoteDebug Debug;
 
 String convertToTime(int data);
-int convertToInteger(String &timeStr);
-bool getPumpModesJson(SpaInterface &si, int pumpNumber, JsonObject pumps);
 
-bool getPumpInstalledState(String pumpState);
-String getPumpSpeedType(String pumpState);
-String getPumpPossibleStates(String pumpState);
-int getPumpSpeedMax(String pumpState);
-int getPumpSpeedMin(String pumpState);
+/// @brief FNV-1a hash, pass the previous result as hash to continue over several buffers.
+uint32_t fnv1a(const char *data, size_t length, uint32_t hash = 2166136261u);
 
+/// @brief Print that keeps the FNV-1a hash and length of what is written, so a document can be
+/// hashed and measured in one pass without serializing it to a buffer.
+class HashPrint : public Print {
+  public:
+    HashPrint(uint32_t hash = 2166136261u) : _hash(hash) {}
+    size_t write(uint8_t c) override { _hash = (_hash ^ c) * 16777619u; _length++; return 1; }
+    size_t write(const uint8_t *data, size_t size) override { _hash = fnv1a((const char *)data, size, _hash); _length += size; return size; }
+    uint32_t hash() const { return _hash; }
+    size_t length() const { return _length; }
+
+  private:
+    uint32_t _hash;
+    size_t _length = 0;
+};
+
+/// @brief Index of the string value in a table of strings.
+/// @return -1 if there is no match
+template <size_t N>
+int lookupIndex(const std::array<const char*, N> &table, StringView value)
+{
+  for (size_t i = 0; i < N; i++) {
+    if (value == table[i]) return i;
+  }
+  return -1;
+}
+
+/// @brief Send a command to the spa.
+///
+/// The value is parsed in place, nothing is allocated before the spa command is built.
+/// @return False if the command is unknown, its pump / timer number is out of range or the value is invalid
+bool applySpaCommand(SpaInterface &si, SpaCommandName command, StringView value);
+bool getPumpModesJson(SpaInterface &si, const SpaStatusSnapshot &snapshot, int pumpNumber, JsonObject pumps);
+void getStatisticsJson(const RollingStatistics &stats, float divisor, JsonObject json);
+
+/// @brief Set a JSON member to a fixed point value as a plain number, so the document also encodes as MessagePack.
+///
+/// ArduinoJson prints doubles rounded to 9 decimals, which gives back the exact decimals of these readings.
+template <typename T, uint8_t Decimals>
+void setFixedPointJson(T target, FixedPoint<Decimals> value) {
+  target = (double)value.raw() / FixedPoint<Decimals>::scale;
+}
+
+/// @brief Build the status document.
+/// @return False if the document ran out of memory
+bool generateStatusJson(SpaInterface &si, MQTTClientWrapper &mqttClient, JsonDocument &json);
 bool generateStatusJson(SpaInterface &si, MQTTClientWrapper &mqttClient, String &output, bool prettyJson=false);
 
+/// @brief Encode the same document as JSON and MessagePack, reporting size and time per encode.
+/// @param json document to encode, see StatusJsonCache::getDocument
+/// @param result receives {"iterations", "json": {"bytes", "us"}, "msgpack": {"bytes", "us"}}
+void compareStatusEncodings(const JsonDocument &json, JsonObject result, int iterations = 20);
+
+/// @brief Writes the visited properties as a JSON object per register group straight to a stream.
+///
+/// Only the current value is ever held in RAM, so the output can be any size.
+/// Call begin(), SpaProperties::visitProperties, then end().
+class PropertyJsonWriter : public PropertyVisitor {
+  public:
+    PropertyJsonWriter(Print &out) : _out(out) {}
+
+    void begin() { _out.write('{'); _first = true; }
+    void end() { _out.write('}'); }
+
+    void beginGroup(const char *name) override { writeKey(name); _out.write('{'); _first = true; }
+    void endGroup() override { _out.write('}'); _first = false; }
+
+    void visit(const char *name, int value) override { writeKey(name); _out.print(value); }
+    void visit(const char *name, bool value) override { writeKey(name); _out.print(value ? "true" : "false"); }
+    void visit(const char *name, time_t value) override { writeKey(name); _out.print((long)value); }
+    void visit(const char *name, const String &value) override { writeKey(name); writeString(value.c_str()); }
+    void visit(const char *name, FixedPoint<1> value) override { writeKey(name); writeFixedPoint(value); }
+    void visit(const char *name, FixedPoint<2> value) override { writeKey(name); writeFixedPoint(value); }
+
+  private:
+    Print &_out;
+    bool _first = true;
+
+    void writeKey(const char *name);
+    void writeString(const char *value);
+
+    template <uint8_t Decimals>
+    void writeFixedPoint(FixedPoint<Decimals> value) {
+      char buffer[FixedPoint<Decimals>::maxChars];
+      _out.write(buffer, value.toChars(buffer, sizeof(buffer)));
+    }
+};
+
+/// @brief Firmware health counters kept by the main loop.
+struct RuntimeStatistics {
+  unsigned long bootMillis = 0;
+  uint64_t loopMicrosSum = 0;
+  uint32_t loopCount = 0;
+  uint32_t loopMicrosMax = 0;
+  uint32_t mqttConnects = 0;
+  uint32_t mqttConnectFailures = 0;
+  unsigned long discoveryMillis = 0;    // Duration of the last Home Assistant discovery run
+  uint32_t discoveryBytes = 0;          // Topic and payload bytes sent by the last discovery run
+  uint32_t discoveryPending = 0;        // Entities the current discovery run has still to go through
+
+  void addLoop(uint32_t micros) {
+    loopMicrosSum += micros;
+    loopCount++;
+    if (micros > loopMicrosMax) loopMicrosMax = micros;
+  }
+};
+
+/// @brief Writes metrics in the Prometheus text exposition format straight to a stream.
+class PrometheusWriter {
+  public:
+    PrometheusWriter(Print &out) : _out(out) {}
+
+    /// @brief HELP and TYPE lines, once before the samples of a metric.
+    void family(const char *name, const char *type, const char *help);
+
+    /// @param labels label set without the braces (eg pump="1"), or nullptr
+    void sample(const char *name, const char *labels, long value);
+    void sample(const char *name, const char *labels, unsigned long value);
+    void sample(const char *name, const char *labels, double value);
+
+    template <uint8_t Decimals>
+    void sample(const char *name, const char *labels, FixedPoint<Decimals> value) {
+      char buffer[FixedPoint<Decimals>::maxChars];
+      size_t length = value.toChars(buffer, sizeof(buffer));
+      writeName(name, labels);
+      _out.write(buffer, length);
+      _out.write('\n');
+    }
+
+  private:
+    Print &_out;
+
+    void writeName(const char *name, const char *labels);
+};
+
+/// @brief Write the numeric spa readings and firmware internals as Prometheus metrics.
+void writeMetrics(SpaInterface &si, MQTTClientWrapper &mqttClient, const RuntimeStatistics &stats, Print &out);
+
+/// @brief Status document and its serialization, shared by /json, /msgpack and the MQTT topics.
+///
+/// Only rebuilt when a new frame has been decoded, the MQTT connection state changes or
+/// invalidate() is called, so any number of readers cost one document and one serialization per frame.
+class StatusJsonCache {
+  public:
+    StatusJsonCache(SpaInterface &si, MQTTClientWrapper &mqttClient) : _si(si), _mqttClient(mqttClient) {}
+
+    /// @brief Current status JSON, regenerated first if it is stale.
+    /// @return Empty if the JSON could not be generated
+    const String& get();
+
+    /// @brief Quoted entity tag for get(), derived from the content so an unchanged frame keeps its tag.
+    const String& getETag() { get(); return _etag; }
+
+    /// @brief The document get() is serialized from, for MessagePack, delta and property topics.
+    /// @return nullptr if the status could not be generated
+    const JsonDocument *getDocument() { return refresh() ? &_document : nullptr; }
+
+    /// @brief Force a rebuild on the next get(), for changes that do not come with a new frame.
+    void invalidate() { _valid = false; }
+
+  private:
+    SpaInterface &_si;
+    MQTTClientWrapper &_mqttClient;
+    JsonDocument _document;
+    String _json;
+    String _etag;
+    uint32_t _snapshotVersion = 0;
+    bool _mqttConnected = false;
+    bool _valid = false;
+
+    /// @brief Rebuild the document and JSON if they are stale.
+    /// @return False if the status could not be generated
+    bool refresh();
+};
+
 #endif // SPAUTILS_H
@@ -0,0 +1,37 @@
+#include "StatusDelta.h"
+
+bool generateStatusDelta(JsonVariantConst previous, JsonVariantConst current, JsonObject delta) {
+  bool changed = false;
+
+  for (JsonPairConst member : current.as<JsonObjectConst>()) {
+    JsonVariantConst before = previous[member.key()];
+    if (member.value().is<JsonObjectConst>() && before.is<JsonObjectConst>()) {
+      if (generateStatusDelta(before, member.value(), delta[member.key()].to<JsonObject>())) changed = true;
+      else delta.remove(member.key());
+    } else if (before.isNull() || before != member.value()) {
+      delta[member.key()] = member.value();
+      changed = true;
+    }
+  }
+
+  for (JsonPairConst member : previous.as<JsonObjectConst>()) {
+    if (current[member.key()].isNull()) {
+      delta[member.key()] = nullptr;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+void mergeStatusDelta(JsonObject target, JsonObjectConst delta) {
+  for (JsonPairConst member : delta) {
+    if (member.value().is<JsonObjectConst>()) {
+      auto existing = target[member.key()];
+      JsonObject child = existing.is<JsonObject>() ? existing.as<JsonObject>() : existing.to<JsonObject>();
+      mergeStatusDelta(child, member.value());
+    } else {
+      target[member.key()] = member.value();
+    }
+  }
+}
@@ -0,0 +1,18 @@
+#ifndef STATUSDELTA_H
+#define STATUSDELTA_H
+
+#include <ArduinoJson.h>
+
+/// @brief Build a JSON merge patch (RFC 7396) that turns previous into current.
+///
+/// Objects are compared member by member so only the changed leaves are included,
+/// members missing from current are set to null.
+/// @return True if anything changed
+bool generateStatusDelta(JsonVariantConst previous, JsonVariantConst current, JsonObject delta);
+
+/// @brief Add a delta from generateStatusDelta to target, eg to collect changes not sent yet.
+///
+/// Unlike an RFC 7396 merge the null members are kept so target still says what was removed.
+void mergeStatusDelta(JsonObject target, JsonObjectConst delta);
+
+#endif // STATUSDELTA_H
@@ -10,6 +10,18 @@ void WebUI::setWifiManagerCallback(void (*f)()) {
     _wifiManagerCallback = f;
 }
 
+void WebUI::setHistory(SpaHistory *history) {
+    _history = history;
+}
+
+void WebUI::setStatusCache(StatusJsonCache *statusCache) {
+    _statusCache = statusCache;
+}
+
+void WebUI::setRuntimeStatistics(RuntimeStatistics *stats) {
+    _runtimeStats = stats;
+}
+
 const char * WebUI::getError() {
     return Update.errorString();
 }
@@ -28,6 +40,24 @@ void WebUI::begin() {
     server->on("/json", HTTP_GET, [&]() {
         debugD("uri: %s", server->uri().c_str());
         server->sendHeader("Connection", "close");
+        if (_statusCache != nullptr) {
+            const String &json = _statusCache->get();
+            if (json.isEmpty()) {
+                server->send(200, "text/text", "Error generating json");
+                return;
+            }
+            // Browsers revalidate every poll and get a bodyless 304 until a frame changes the status.
+            const String &etag = _statusCache->getETag();
+            server->sendHeader("ETag", etag);
+            server->sendHeader("Cache-Control", "no-cache");
+            if (server->header("If-None-Match") == etag) {
+                server->send(304);
+            } else {
+                server->send(200, "text/json", json);
+            }
+            return;
+        }
+
         String json;
         if (generateStatusJson(*_spa, *_mqttClient, json, true)) {
             server->send(200, "text/json", json.c_str());
@@ -36,6 +66,64 @@ void WebUI::begin() {
         }
     });
 
+    server->on("/json/all", HTTP_GET, [&]() {
+        debugD("uri: %s", server->uri().c_str());
+        // Every property grouped by register, streamed as it is written so the document is never held in RAM.
+        server->sendHeader("Connection", "close");
+        server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+        server->send(200, "application/json", "");
+
+        ChunkedResponsePrint response(*server);
+        PropertyJsonWriter writer(response);
+        writer.begin();
+        _spa->visitProperties(writer);
+        writer.end();
+        response.end();
+    });
+
+    server->on("/metrics", HTTP_GET, [&]() {
+        debugD("uri: %s", server->uri().c_str());
+        if (_runtimeStats == nullptr) {
+            server->send(503, "text/plain", "Metrics not available");
+            return;
+        }
+        server->sendHeader("Connection", "close");
+        server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+        server->send(200, "text/plain; version=0.0.4", "");
+
+        ChunkedResponsePrint response(*server);
+        writeMetrics(*_spa, *_mqttClient, *_runtimeStats, response);
+        response.end();
+    });
+
+    server->on("/msgpack", HTTP_GET, [&]() {
+        debugD("uri: %s", server->uri().c_str());
+        const JsonDocument *status = _statusCache == nullptr ? nullptr : _statusCache->getDocument();
+        if (status == nullptr) {
+            server->send(200, "text/text", "Error generating json");
+            return;
+        }
+        const JsonDocument &json = *status;
+        server->sendHeader("Connection", "close");
+
+        // /msgpack?benchmark=1 reports size and encode time of JSON against MessagePack for the current status.
+        if (server->hasArg("benchmark")) {
+            JsonDocument result;
+            compareStatusEncodings(json, result.to<JsonObject>());
+            String output;
+            serializeJson(result, output);
+            server->send(200, "application/json", output);
+            return;
+        }
+
+        server->setContentLength(measureMsgPack(json));
+        server->send(200, "application/msgpack", "");
+        WiFiClient client = server->client();
+        BufferedPrint writer(client);
+        serializeMsgPack(json, writer);
+        writer.flushBuffer();
+    });
+
     server->on("/reboot", HTTP_GET, [&]() {
         debugD("uri: %s", server->uri().c_str());
         server->send(200, "text/html", WebUI::rebootPage);
@@ -122,6 +210,19 @@ void WebUI::begin() {
         if (server->hasArg("mqttUsername")) _config->MqttUsername.setValue(server->arg("mqttUsername"));
         if (server->hasArg("mqttPassword")) _config->MqttPassword.setValue(server->arg("mqttPassword"));
         if (server->hasArg("updateFrequency")) _config->UpdateFrequency.setValue(server->arg("updateFrequency").toInt());
+        if (server->hasArg("statsWindow")) _config->StatisticsWindow.setValue(server->arg("statsWindow").toInt());
+        if (server->hasArg("statsSensors")) _config->StatisticsSensors.setValue(server->arg("statsSensors") == "1");
+        if (server->hasArg("mqttDelta")) _config->MqttDeltaStatus.setValue(server->arg("mqttDelta") == "1");
+        if (server->hasArg("mqttFullInterval")) _config->MqttFullStatusInterval.setValue(server->arg("mqttFullInterval").toInt());
+        if (server->hasArg("mqttPropTopics")) _config->MqttPropertyTopics.setValue(server->arg("mqttPropTopics") == "1");
+        if (server->hasArg("mqttMsgPack")) _config->MqttMsgPackStatus.setValue(server->arg("mqttMsgPack") == "1");
+        if (server->hasArg("influxHost")) _config->InfluxHost.setValue(server->arg("influxHost"));
+        if (server->hasArg("influxPort")) _config->InfluxPort.setValue(server->arg("influxPort").toInt());
+        if (server->hasArg("influxChangedOnly")) _config->InfluxChangedOnly.setValue(server->arg("influxChangedOnly") == "1");
+        if (server->hasArg("publishMinInterval")) _config->PublishMinInterval.setValue(server->arg("publishMinInterval").toInt());
+        if (server->hasArg("publishHeartbeat")) _config->PublishHeartbeat.setValue(server->arg("publishHeartbeat").toInt());
+        if (server->hasArg("mqttAbbrevAd")) _config->MqttAbbreviateDiscovery.setValue(server->arg("mqttAbbrevAd") == "1");
+        if (server->hasArg("mqttDeviceAd")) _config->MqttDeviceDiscovery.setValue(server->arg("mqttDeviceAd") == "1");
         _config->writeConfig();
         server->sendHeader("Connection", "close");
         server->send(200, "text/plain", "Updated");
@@ -135,34 +236,35 @@ void WebUI::begin() {
         configJson += "\"mqttPort\":\"" + String(_config->MqttPort.getValue()) + "\",";
         configJson += "\"mqttUsername\":\"" + _config->MqttUsername.getValue() + "\",";
         configJson += "\"mqttPassword\":\"" + _config->MqttPassword.getValue() + "\",";
-        configJson += "\"updateFrequency\":" + String(_config->UpdateFrequency.getValue());
+        configJson += "\"updateFrequency\":" + String(_config->UpdateFrequency.getValue()) + ",";
+        configJson += "\"statsWindow\":" + String(_config->StatisticsWindow.getValue()) + ",";
+        configJson += "\"statsSensors\":" + String(_config->StatisticsSensors.getValue() ? 1 : 0) + ",";
+        configJson += "\"mqttDelta\":" + String(_config->MqttDeltaStatus.getValue() ? 1 : 0) + ",";
+        configJson += "\"mqttFullInterval\":" + String(_config->MqttFullStatusInterval.getValue()) + ",";
+        configJson += "\"mqttPropTopics\":" + String(_config->MqttPropertyTopics.getValue() ? 1 : 0) + ",";
+        configJson += "\"mqttMsgPack\":" + String(_config->MqttMsgPackStatus.getValue() ? 1 : 0) + ",";
+        configJson += "\"influxHost\":\"" + _config->InfluxHost.getValue() + "\"" + ",";
+        configJson += "\"influxPort\":" + String(_config->InfluxPort.getValue()) + ",";
+        configJson += "\"influxChangedOnly\":" + String(_config->InfluxChangedOnly.getValue() ? 1 : 0) + ",";
+        configJson += "\"publishMinInterval\":" + String(_config->PublishMinInterval.getValue()) + ",";
+        configJson += "\"publishHeartbeat\":" + String(_config->PublishHeartbeat.getValue()) + ",";
+        configJson += "\"mqttAbbrevAd\":" + String(_config->MqttAbbreviateDiscovery.getValue() ? 1 : 0) + ",";
+        configJson += "\"mqttDeviceAd\":" + String(_config->MqttDeviceDiscovery.getValue() ? 1 : 0);
         configJson += "}";
         server->send(200, "application/json", configJson);
     });
 
     server->on("/set", HTTP_POST, [&]() {
-        //In theory with minor modification, we can reuse mqttCallback here
-        //for (uint8_t i = 0; i < server->args(); i++) updateSpaSetting("set/" + server->argName(0), server->arg(0));
-        if (server->hasArg("temperatures_setPoint")) {
-            float newTemperature = server->arg("temperatures_setPoint").toFloat();
-            _spa->setSTMP(int(newTemperature*10));
-            server->send(200, "text/plain", "Temperature updated");
-        }
-        else if (server->hasArg("status_datetime")) {
-            String p = server->arg("status_datetime");
-            tmElements_t tm;
-            tm.Year=CalendarYrToTm(p.substring(0,4).toInt());
-            tm.Month=p.substring(5,7).toInt();
-            tm.Day=p.substring(8,10).toInt();
-            tm.Hour=p.substring(11,13).toInt();
-            tm.Minute=p.substring(14,16).toInt();
-            tm.Second=p.substring(17).toInt();
-            _spa->setSpaTime(makeTime(tm));
-            server->send(200, "text/plain", "Date/Time updated");
-        }
-        else {
-            server->send(400, "text/plain", "Invalid temperature value");
+        // Same commands as the MQTT set topics, field name = command name
+        for (int i = 0; i < server->args(); i++) {
+            String name = server->argName(i);
+            String value = server->arg(i);
+            if (applySpaCommand(*_spa, lookupSpaCommand(name.c_str(), name.length()), StringView{value.c_str(), value.length()})) {
+                server->send(200, "text/plain", name + " updated");
+                return;
+            }
         }
+        server->send(400, "text/plain", "Unknown command or invalid value");
     });
 
     server->on("/wifi-manager", HTTP_GET, [&]() {
@@ -178,12 +280,29 @@ void WebUI::begin() {
         server->send(200, "text/html", WebUI::jsonHTMLTemplate);
     });
 
+    server->on("/history", HTTP_GET, [&]() {
+        debugD("uri: %s", server->uri().c_str());
+        int tier = server->hasArg("tier") ? server->arg("tier").toInt() : SpaHistory::TIER_RAW;
+        if (_history == nullptr || !_history->isValidTier(tier)) {
+            server->send(400, "text/plain", "History not available");
+            return;
+        }
+        // Samples are streamed straight out of the ring buffers, see HistoryExportHeader for the format.
+        server->sendHeader("Connection", "close");
+        server->setContentLength(_history->exportSize(tier));
+        server->send(200, "application/octet-stream", "");
+        WiFiClient client = server->client();
+        _history->exportTier(tier, client);
+    });
+
     server->on("/status", HTTP_GET, [&]() {
         debugD("uri: %s", server->uri().c_str());
         server->sendHeader("Connection", "close");
         server->send(200, "text/plain", _spa->statusResponse.getValue());
     });
 
+    static const char *headerKeys[] = {"If-None-Match"};
+    server->collectHeaders(headerKeys, 1);
     server->begin();
 
     initialised = true;
@@ -8,6 +8,7 @@
 
 #include "SpaInterface.h"
 #include "SpaUtils.h"
+#include "SpaHistory.h"
 #include "Config.h"
 #include "MQTTClientWrapper.h"
 
@@ -17,6 +18,36 @@
 
 extern RemoteDebug Debug;
 
+/// @brief Print that sends its output as HTTP chunks, for responses started with CONTENT_LENGTH_UNKNOWN.
+class ChunkedResponsePrint : public Print {
+    public:
+        ChunkedResponsePrint(WebServer &server) : _server(server) {}
+
+        size_t write(uint8_t c) override {
+            _buffer[_length++] = c;
+            if (_length == sizeof(_buffer)) flushChunk();
+            return 1;
+        }
+
+        /// @brief Send whatever is buffered as a chunk.
+        void flushChunk() {
+            if (_length == 0) return;
+            _server.sendContent((const char *)_buffer, _length);
+            _length = 0;
+        }
+
+        /// @brief Send the last chunk and the terminating empty chunk.
+        void end() {
+            flushChunk();
+            _server.sendContent("");
+        }
+
+    private:
+        WebServer &_server;
+        uint8_t _buffer[512];
+        size_t _length = 0;
+};
+
 class WebUI {
     public:
         std::unique_ptr<WebServer> server;
@@ -25,6 +56,18 @@ class WebUI {
         /// @brief Set the function to be called when properties have been updated.
         /// @param f
         void setWifiManagerCallback(void (*f)());
+
+        /// @brief Set the history store served on /history.
+        /// @param history
+        void setHistory(SpaHistory *history);
+
+        /// @brief Set the shared status JSON served on /json.
+        /// @param statusCache
+        void setStatusCache(StatusJsonCache *statusCache);
+
+        /// @brief Set the firmware counters reported on /metrics.
+        /// @param stats
+        void setRuntimeStatistics(RuntimeStatistics *stats);
         void begin();
         bool initialised = false;
 
@@ -32,6 +75,9 @@ class WebUI {
         SpaInterface *_spa;
         Config *_config;
         MQTTClientWrapper *_mqttClient;
+        SpaHistory *_history = nullptr;
+        StatusJsonCache *_statusCache = nullptr;
+        RuntimeStatistics *_runtimeStats = nullptr;
         void (*_wifiManagerCallback)() = nullptr;
 
         const char* getError();
@@ -308,6 +354,19 @@ R"(<!DOCTYPE html>
 <tr><td>MQTT Username:</td><td><input type='text' name='mqttUsername' id='mqttUsername'></td></tr>
 <tr><td>MQTT Password:</td><td><input type='text' name='mqttPassword' id='mqttPassword'></td></tr>
 <tr><td>Poll Frequency (seconds):</td><td><input type='number' name='updateFrequency' id='updateFrequency' step="1" min="10" max="300"></td></tr>
+<tr><td>Statistics Window (polls):</td><td><input type='number' name='statsWindow' id='statsWindow' step="1" min="2" max="60"></td></tr>
+<tr><td>Statistics Sensors:</td><td><select name='statsSensors' id='statsSensors'><option value='0'>Disabled</option><option value='1'>Enabled</option></select></td></tr>
+<tr><td>MQTT Delta Status:</td><td><select name='mqttDelta' id='mqttDelta'><option value='0'>Disabled</option><option value='1'>Enabled</option></select></td></tr>
+<tr><td>Delta Full Snapshot (minutes):</td><td><input type='number' name='mqttFullInterval' id='mqttFullInterval' step="1" min="1" max="1440"></td></tr>
+<tr><td>MQTT Property Topics:</td><td><select name='mqttPropTopics' id='mqttPropTopics'><option value='0'>Disabled</option><option value='1'>Enabled</option></select></td></tr>
+<tr><td>MQTT MessagePack Status:</td><td><select name='mqttMsgPack' id='mqttMsgPack'><option value='0'>Disabled</option><option value='1'>Enabled</option></select></td></tr>
+<tr><td>InfluxDB UDP Host:</td><td><input type='text' name='influxHost' id='influxHost'></td></tr>
+<tr><td>InfluxDB UDP Port:</td><td><input type='number' name='influxPort' id='influxPort' step="1" min="1" max="65535"></td></tr>
+<tr><td>InfluxDB Changed Fields Only:</td><td><select name='influxChangedOnly' id='influxChangedOnly'><option value='0'>Disabled</option><option value='1'>Enabled</option></select></td></tr>
+<tr><td>Publish Min Interval (seconds):</td><td><input type='number' name='publishMinInterval' id='publishMinInterval' step="1" min="0" max="3600"></td></tr>
+<tr><td>Publish Heartbeat (seconds, 0 = every poll):</td><td><input type='number' name='publishHeartbeat' id='publishHeartbeat' step="1" min="0" max="3600"></td></tr>
+<tr><td>Compact HA Discovery:</td><td><select name='mqttAbbrevAd' id='mqttAbbrevAd'><option value='0'>Disabled</option><option value='1'>Enabled</option></select></td></tr>
+<tr><td>HA Device Discovery (HA 2024.11+):</td><td><select name='mqttDeviceAd' id='mqttDeviceAd'><option value='0'>Disabled</option><option value='1'>Enabled</option></select></td></tr>
 </table>
 <input type='submit' value='Save'>
 </form>
@@ -324,6 +383,19 @@ function loadConfig() {
       document.getElementById('mqttUsername').value = data.mqttUsername;
       document.getElementById('mqttPassword').value = data.mqttPassword;
       document.getElementById('updateFrequency').value = data.updateFrequency;
+      document.getElementById('statsWindow').value = data.statsWindow;
+      document.getElementById('statsSensors').value = data.statsSensors;
+      document.getElementById('mqttDelta').value = data.mqttDelta;
+      document.getElementById('mqttFullInterval').value = data.mqttFullInterval;
+      document.getElementById('mqttPropTopics').value = data.mqttPropTopics;
+      document.getElementById('mqttMsgPack').value = data.mqttMsgPack;
+      document.getElementById('influxHost').value = data.influxHost;
+      document.getElementById('influxPort').value = data.influxPort;
+      document.getElementById('influxChangedOnly').value = data.influxChangedOnly;
+      document.getElementById('publishMinInterval').value = data.publishMinInterval;
+      document.getElementById('publishHeartbeat').value = data.publishHeartbeat;
+      document.getElementById('mqttAbbrevAd').value = data.mqttAbbrevAd;
+      document.getElementById('mqttDeviceAd').value = data.mqttDeviceAd;
     })
   .catch(error => console.error('Error loading config:', error));
 }
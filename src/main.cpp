@@ -12,6 +12,8 @@
 #include "Config.h"
 #include "SpaInterface.h"
 #include "SpaUtils.h"
+#include "SpaHistory.h"
+#include "InfluxExporter.h"
 #include "HAAutoDiscovery.h"
 #include "MQTTClientWrapper.h"
 
@@ -23,6 +25,8 @@ unsigned long bootStartMillis;  // To track when the device started
 RemoteDebug Debug;
 
 SpaInterface si;
+SpaHistory history;
+InfluxExporter influx;
 Config config;
 
 #if defined(SPACTRLPCB)
@@ -37,6 +41,8 @@ WiFiClient wifi;
 MQTTClientWrapper mqttClient(wifi);
 
 WebUI ui(&si, &config, &mqttClient);
+StatusJsonCache statusCache(si, mqttClient);
+RuntimeStatistics runtimeStats;
 
 
 
@@ -47,11 +53,39 @@ ulong bootTime = millis();
 ulong statusLastPublish = millis();
 bool delayedStart = true; // Delay spa connection for 10sec after boot to allow for external debugging if required.
 bool autoDiscoveryPublished = false;
+uint32_t historySnapshotVersion = 0;
+JsonDocument statusDeltaBaseline;  // status as last sent on the delta topic
+ulong statusDeltaLastFull = 0;
+bool statusDeltaFullDue = true;
+JsonDocument propertyTopicsBaseline;  // status as last queued for the per property topics
+JsonDocument propertyTopicsPending;   // leaves still to publish, null leaves clear their topic
+bool haBirthPending = false;  // Home Assistant came online, republish once haBirthAt is reached
+ulong haBirthAt = 0;
+
+// Home Assistant publishes "online" here when it starts, devices wait a random time up to
+// HA_BIRTH_SPREAD ms before republishing so a fleet of devices does not all answer at once.
+#define HA_STATUS_TOPIC "homeassistant/status"
+#ifndef HA_BIRTH_SPREAD
+  #define HA_BIRTH_SPREAD 5000
+#endif
+
+// The stored discovery hashes only say what was sent, not what the broker still holds.  Each complete
+// run retains its id on mqttDiscoverySession, if the broker does not hand the stored id back after
+// connecting it lost its retained messages (or is a different broker) and every config is republished.
+#ifndef DISCOVERY_SESSION_TIMEOUT
+  #define DISCOVERY_SESSION_TIMEOUT 3000  // ms to wait for the retained id after connecting
+#endif
+uint32_t discoveryBrokerSession = 0;  // Id retained on the broker, 0 if there is none
+bool discoveryBrokerSessionReceived = false;
+ulong discoverySessionDeadline = 0;
 
 String mqttBase = "";
 String mqttStatusTopic = "";
+String mqttStatusDeltaTopic = "";
+String mqttStatusMsgPackTopic = "";
 String mqttSet = "";
 String mqttAvailability = "";
+String mqttDiscoverySession = "";
 
 String spaSerialNumber = "";
 
@@ -123,6 +157,7 @@ void configChangeCallbackString(const char* name, String value) {
   else if (strcmp(name, "MqttPort") == 0) updateMqtt = true;
   else if (strcmp(name, "MqttUsername") == 0) updateMqtt = true;
   else if (strcmp(name, "MqttPassword") == 0) updateMqtt = true;
+  else if (strcmp(name, "InfluxHost") == 0) influx.setServer(value, config.InfluxPort.getValue());
   else if (strcmp(name, "SpaName") == 0) { } //TODO - Changing the SpaName currently requires the user to:
                                   // delete the entities in MQTT then reboot the ESP
 }
@@ -130,15 +165,260 @@ void configChangeCallbackString(const char* name, String value) {
 void configChangeCallbackInt(const char* name, int value) {
   debugD("%s: %i", name, value);
   if (strcmp(name, "UpdateFrequency") == 0) si.setUpdateFrequency(value);
+  else if (strcmp(name, "PublishMinInterval") == 0) si.setPublishPolicy(value, config.PublishHeartbeat.getValue());
+  else if (strcmp(name, "PublishHeartbeat") == 0) si.setPublishPolicy(config.PublishMinInterval.getValue(), value);
+  else if (strcmp(name, "InfluxPort") == 0) influx.setServer(config.InfluxHost.getValue(), value);
+  else if (strcmp(name, "StatisticsWindow") == 0) {
+    si.setStatisticsWindow(value);
+    statusCache.invalidate();
+  }
+}
+
+void configChangeCallbackBool(const char* name, bool value) {
+  debugD("%s: %i", name, value);
+  if (strcmp(name, "StatisticsSensors") == 0) autoDiscoveryPublished = false; // add or remove the entities
+  else if (strcmp(name, "MqttAbbreviateDiscovery") == 0) autoDiscoveryPublished = false;
+  else if (strcmp(name, "MqttDeviceDiscovery") == 0) autoDiscoveryPublished = false;
+  else if (strcmp(name, "MqttDeltaStatus") == 0) statusDeltaFullDue = true;
+  else if (strcmp(name, "InfluxChangedOnly") == 0) influx.setChangedOnly(value);
+}
+
+// Home Assistant entities, one row each.  Presence is checked and option lists / pump speed ranges
+// are filled in by mqttHaAutoDiscovery.
+static constexpr AutoDiscoveryEntity discoveryEntities[] = {
+  adSensor("Water Temperature", "{{ value_json.temperatures.water }}", "WaterTemperature", "temperature", "", "measurement", "°C"),
+  adSensor("Case Temperature", "{{ value_json.temperatures.case }}", "CaseTemperature", "temperature", "diagnostic", "measurement", "°C"),
+  adSensor("Heater Temperature", "{{ value_json.temperatures.heater }}", "HeaterTemperature", "temperature", "diagnostic", "measurement", "°C"),
+  adSensor("Mains Voltage", "{{ value_json.power.voltage }}", "MainsVoltage", "voltage", "diagnostic", "measurement", "V"),
+  adSensor("Mains Current", "{{ value_json.power.current }}", "MainsCurrent", "current", "diagnostic", "measurement", "A"),
+  adSensor("Power", "{{ value_json.power.power }}", "Power", "power", "diagnostic", "measurement", "W"),
+  adSensor("Total Energy", "{{ value_json.power.totalenergy }}", "TotalEnergy", "energy", "diagnostic", "measurement", "kWh"),
+
+  // Rolling statistics sensors are optional, when disabled empty configs are published so HA removes them.
+  adSensor("Mains Voltage Min", "{{ value_json.stats.voltage.min }}", "stats_voltage_min", "voltage", "diagnostic", "measurement", "V", AdPresence::Statistics),
+  adSensor("Mains Voltage Max", "{{ value_json.stats.voltage.max }}", "stats_voltage_max", "voltage", "diagnostic", "measurement", "V", AdPresence::Statistics),
+  adSensor("Mains Voltage Mean", "{{ value_json.stats.voltage.mean }}", "stats_voltage_mean", "voltage", "diagnostic", "measurement", "V", AdPresence::Statistics),
+  adSensor("Mains Current Min", "{{ value_json.stats.current.min }}", "stats_current_min", "current", "diagnostic", "measurement", "A", AdPresence::Statistics),
+  adSensor("Mains Current Max", "{{ value_json.stats.current.max }}", "stats_current_max", "current", "diagnostic", "measurement", "A", AdPresence::Statistics),
+  adSensor("Mains Current Mean", "{{ value_json.stats.current.mean }}", "stats_current_mean", "current", "diagnostic", "measurement", "A", AdPresence::Statistics),
+  adSensor("Power Min", "{{ value_json.stats.power.min }}", "stats_power_min", "power", "diagnostic", "measurement", "W", AdPresence::Statistics),
+  adSensor("Power Max", "{{ value_json.stats.power.max }}", "stats_power_max", "power", "diagnostic", "measurement", "W", AdPresence::Statistics),
+  adSensor("Power Mean", "{{ value_json.stats.power.mean }}", "stats_power_mean", "power", "diagnostic", "measurement", "W", AdPresence::Statistics),
+
+  adSensor("State", "{{ value_json.status.state }}", "State", "", ""),
+  adEntity(AdComponent::BinarySensor, "Heating Active", "{{ value_json.status.heatingActive }}", "HeatingActive", "heat"),
+  adEntity(AdComponent::BinarySensor, "Ozone Active", "{{ value_json.status.ozoneActive }}", "OzoneActive", "running"),
+  adEntity(AdComponent::Climate, "", "{{ value_json.temperatures }}", "Heating"),
+
+  adFan("Pump 1", "{{ value_json.pumps.pump1 }}", "pump1", AdOptions::PumpMode, 0, 0, AdPresence::Pump, 1),
+  adFan("Pump 2", "{{ value_json.pumps.pump2 }}", "pump2", AdOptions::PumpMode, 0, 0, AdPresence::Pump, 2),
+  adFan("Pump 3", "{{ value_json.pumps.pump3 }}", "pump3", AdOptions::PumpMode, 0, 0, AdPresence::Pump, 3),
+  adFan("Pump 4", "{{ value_json.pumps.pump4 }}", "pump4", AdOptions::PumpMode, 0, 0, AdPresence::Pump, 4),
+  adFan("Pump 5", "{{ value_json.pumps.pump5 }}", "pump5", AdOptions::PumpMode, 0, 0, AdPresence::Pump, 5),
+
+  adSensor("Heatpump Ambient Temperature", "{{ value_json.temperatures.heatpumpAmbient }}", "HPAmbTemp", "temperature", "diagnostic", "measurement", "°C", AdPresence::HeatPump),
+  adSensor("Heatpump Condensor Temperature", "{{ value_json.temperatures.heatpumpCondensor }}", "HPCondTemp", "temperature", "diagnostic", "measurement", "°C", AdPresence::HeatPump),
+  adSelect("Heatpump Mode", "{{ value_json.heatpump.mode }}", "heatpump_mode", AdOptions::HeatPumpMode, "", AdPresence::HeatPump),
+  adEntity(AdComponent::Switch, "Aux Heat Element", "{{ value_json.heatpump.auxheat }}", "heatpump_auxheat", "", "", AdPresence::HeatPump),
+
+  adLight("Lights", "{{ value_json.lights }}", "lights", AdOptions::LightEffect),
+  adSelect("Lights Speed", "{{ value_json.lights.speed }}", "lights_speed", AdOptions::LightSpeed),
+  adSelect("Sleep Timer 1", "{{ value_json.sleepTimers.timer1.state }}", "sleepTimers_1_state", AdOptions::SleepTimer, "config"),
+  adSelect("Sleep Timer 2", "{{ value_json.sleepTimers.timer2.state }}", "sleepTimers_2_state", AdOptions::SleepTimer, "config"),
+  adText("Date Time", "{{ value_json.status.datetime }}", "status_datetime", "[0-9]{4}-[0-9]{2}-[0-9]{2} [0-9]{2}:[0-9]{2}"),
+  adText("Sleep Timer 1 Begin", "{{ value_json.sleepTimers.timer1.begin }}", "sleepTimers_1_begin", "[0-2][0-9]:[0-9]{2}"),
+  adText("Sleep Timer 1 End", "{{ value_json.sleepTimers.timer1.end }}", "sleepTimers_1_end", "[0-2][0-9]:[0-9]{2}"),
+  adText("Sleep Timer 2 Begin", "{{ value_json.sleepTimers.timer2.begin }}", "sleepTimers_2_begin", "[0-2][0-9]:[0-9]{2}"),
+  adText("Sleep Timer 2 End", "{{ value_json.sleepTimers.timer2.end }}", "sleepTimers_2_end", "[0-2][0-9]:[0-9]{2}"),
+  adFan("Blower", "{{ value_json.blower }}", "blower", AdOptions::Blower, 1, 5),
+  adSelect("Spa Mode", "{{ value_json.status.spaMode }}", "status_spaMode", AdOptions::SpaMode),
+};
+
+static const size_t discoveryEntityCount = sizeof(discoveryEntities) / sizeof(discoveryEntities[0]);
+
+// Hash of the topic and payload last published for each table row, persisted so unchanged
+// entities are not republished after a reconnect or reboot.  The extra slot is the device config.
+static const uint32_t DISCOVERY_HASH_REMOVED = 0;         // Empty config published (or never published)
+static const uint32_t DISCOVERY_HASH_UNKNOWN = 0xffffffff; // Nothing stored yet, publish or remove
+static const size_t DISCOVERY_DEVICE_SLOT = discoveryEntityCount;
+uint32_t discoveryHashes[discoveryEntityCount + 1];
+bool discoveryHashesLoaded = false;
+uint32_t discoverySession = 0;         // Id of the last complete run, see DISCOVERY_SESSION_TIMEOUT
+bool discoverySlotsChanged = false;    // The table changed since the hashes were stored
+std::vector<String> discoveryRetired;  // Rows dropped from the table that still have a config on the broker
+
+/// @brief Ids of the discovery rows, one "component/propertyId" per line, stored with the hashes.
+String discoverySlotIds() {
+  String ids;
+  for (size_t i = 0; i < discoveryEntityCount; i++) {
+    ids += adComponentName(discoveryEntities[i].component);
+    ids += '/';
+    ids += discoveryEntities[i].propertyId;
+    ids += '\n';
+  }
+  return ids;
+}
+
+/// @brief Find the discovery row with a "component/propertyId" id.
+/// @return Row index, or discoveryEntityCount if there is no such row
+size_t discoverySlotIndex(const String &id) {
+  int separator = id.indexOf('/');
+  if (separator < 0) return discoveryEntityCount;
+  for (size_t i = 0; i < discoveryEntityCount; i++) {
+    const char *component = adComponentName(discoveryEntities[i].component);
+    if ((size_t)separator == strlen(component) && strncmp(id.c_str(), component, separator) == 0
+        && strcmp(id.c_str() + separator + 1, discoveryEntities[i].propertyId) == 0) return i;
+  }
+  return discoveryEntityCount;
+}
+
+/// @brief Load the state stored by the last run.  If the table changed since (firmware update) the
+/// hashes are matched to the rows by id, rows that are gone are queued in discoveryRetired.
+void loadDiscoveryState() {
+  for (size_t i = 0; i <= discoveryEntityCount; i++) discoveryHashes[i] = DISCOVERY_HASH_UNKNOWN;
+  discoveryHashesLoaded = true;
+
+  String slots;
+  std::vector<uint32_t> hashes;
+  if (!config.readDiscoveryState(discoverySession, slots, hashes)) {
+    discoverySession = 0;
+    return;
+  }
+
+  String current = discoverySlotIds();
+  if (slots == current && hashes.size() == discoveryEntityCount + 1) {
+    memcpy(discoveryHashes, hashes.data(), sizeof(discoveryHashes));
+    return;
+  }
+
+  debugI("Discovery table changed, matching stored hashes by id");
+  discoverySlotsChanged = true;
+  size_t slot = 0;
+  int start = 0;
+  int end;
+  while (slot + 1 < hashes.size() && (end = slots.indexOf('\n', start)) >= 0) {
+    String id = slots.substring(start, end);
+    start = end + 1;
+    uint32_t hash = hashes[slot++];
+    size_t row = discoverySlotIndex(id);
+    if (row < discoveryEntityCount) discoveryHashes[row] = hash;
+    else if (hash != DISCOVERY_HASH_REMOVED) discoveryRetired.push_back(id);
+  }
+  discoveryHashes[DISCOVERY_DEVICE_SLOT] = hashes.back();
 }
 
-void mqttHaAutoDiscovery() {
-  debugI("Publishing Home Assistant auto discovery");
+void saveDiscoveryState() {
+  config.writeDiscoveryState(discoverySession, discoverySlotIds(), discoveryHashes, discoveryEntityCount + 1);
+  discoverySlotsChanged = false;
+}
+
+/// @brief Check whether a discovery table row applies to this spa and fill in its runtime values.
+/// @return False if the entity should not be published
+bool resolveDiscoveryEntity(const AutoDiscoveryEntity &entity, AutoDiscoveryRuntime &runtime) {
+  runtime = AutoDiscoveryRuntime();
+  runtime.min = entity.min;
+  runtime.max = entity.max;
+
+  switch (entity.options) {
+    case AdOptions::None: break;
+    case AdOptions::SpaMode: runtime.options = si.spaModeStrings.data(); runtime.optionCount = si.spaModeStrings.size(); break;
+    case AdOptions::HeatPumpMode: runtime.options = si.HPMPStrings.data(); runtime.optionCount = si.HPMPStrings.size(); break;
+    case AdOptions::LightEffect: runtime.options = si.colorModeStrings.data(); runtime.optionCount = si.colorModeStrings.size(); break;
+    case AdOptions::LightSpeed: runtime.options = si.lightSpeedMap.data(); runtime.optionCount = si.lightSpeedMap.size(); break;
+    case AdOptions::SleepTimer: runtime.options = si.sleepSelection.data(); runtime.optionCount = si.sleepSelection.size(); break;
+    case AdOptions::Blower: runtime.options = si.blowerStrings.data(); runtime.optionCount = si.blowerStrings.size(); break;
+    case AdOptions::PumpMode: runtime.options = si.autoPumpOptions.data(); runtime.optionCount = si.autoPumpOptions.size(); break;
+  }
+
+  switch (entity.presence) {
+    case AdPresence::Always: return true;
+    case AdPresence::Statistics: return config.StatisticsSensors.getValue();
+    case AdPresence::HeatPump: return si.getHP_Present();
+    case AdPresence::Pump: {
+      const PumpCapabilities &pump = si.getPumpCapabilities(entity.index);
+      if (!pump.installed || pump.stateCount() <= 1) return false;
+      if (!pump.supports(PumpCapabilities::STATE_AUTO)) {
+        runtime.options = nullptr;
+        runtime.optionCount = 0;
+      }
+      if (pump.speedType != 1) {
+        runtime.min = pump.speedMin;
+        runtime.max = pump.speedMax;
+      }
+      return true;
+    }
+  }
+  return false;
+}
 
-  String output;
-  String discoveryTopic;
+// Discovery is published a few entities per loop() pass so spa polling and web requests keep running.
+#ifndef DISCOVERY_BYTES_PER_LOOP
+  #define DISCOVERY_BYTES_PER_LOOP 2048     // topic + payload bytes published per pass
+#endif
+#ifndef DISCOVERY_ENTITIES_PER_LOOP
+  #define DISCOVERY_ENTITIES_PER_LOOP 8     // entities generated per pass, published or not
+#endif
 
+/// @brief State of the Home Assistant discovery run, resumed by mqttHaAutoDiscoveryStep.
+struct DiscoveryJob {
+  bool active = false;
+  bool force = false;
+  size_t next = 0;              // Next row of discoveryEntities
+  unsigned long start = 0;
+  size_t bytes = 0;
+  int published = 0;
+  int skipped = 0;
+  bool hashesChanged = false;
   SpaADInformationTemplate spa;
+  bool deviceMode = false;      // One device config instead of a config per entity
+  JsonDocument device;          // Device config being built
+  size_t entityModeBytes = 0;   // What the same entities take as separate configs, for comparison
+  uint8_t capabilities = 0;     // Only the rows depending on these capabilities, 0 for every row
+  uint32_t session = 0;         // Becomes discoverySession when the run completes
+};
+DiscoveryJob discoveryJob;
+
+// Capabilities that changed since discovery last looked at them, see mqttCapabilitiesChanged
+uint8_t discoveryCapabilityChanges = 0;
+
+/// @brief Capability bits a discovery row depends on, see SpaProperties::capabilityPump.
+uint8_t discoveryEntityCapabilities(const AutoDiscoveryEntity &entity) {
+  switch (entity.presence) {
+    case AdPresence::HeatPump: return SpaProperties::CAPABILITY_HEAT_PUMP;
+    case AdPresence::Pump: return SpaProperties::capabilityPump(entity.index);
+    default: return 0;
+  }
+}
+
+/// @brief Start (or restart) publishing the discovery configs that changed since they were last published.
+/// @param force Publish every entity, eg when the broker may have lost the retained configs
+/// @param capabilities Only look at the rows depending on these capabilities, 0 for every row
+void mqttHaAutoDiscovery(bool force = false, uint8_t capabilities = 0) {
+  if (capabilities == 0) debugI("Publishing Home Assistant auto discovery");
+  else debugI("Refreshing Home Assistant auto discovery, capabilities 0x%02x changed", capabilities);
+
+  if (!discoveryHashesLoaded) loadDiscoveryState();
+
+  // A run that was interrupted keeps the hashes of what it did publish, so restarting only repeats the rest.
+  if (discoveryJob.active && discoveryJob.hashesChanged) saveDiscoveryState();
+  // An unfinished forced run stays forced, the rows it has not reached yet may be missing from the broker.
+  if (discoveryJob.active && discoveryJob.force) force = true;
+  // The broker does not hold what the hashes describe, republish everything under a new id.
+  if (discoverySession == 0 || discoveryBrokerSession != discoverySession) {
+    if (!force) debugI("Discovery session %08lx not on the broker, republishing every config", (unsigned long)discoverySession);
+    force = true;
+  }
+  if (force) capabilities = 0;
+
+  discoveryJob = DiscoveryJob();
+  discoveryJob.active = true;
+  discoveryJob.force = force;
+  discoveryJob.start = millis();
+  discoveryJob.deviceMode = config.MqttDeviceDiscovery.getValue();
+  discoveryJob.capabilities = discoveryJob.deviceMode ? 0 : capabilities;  // the device config always holds every row
+  discoveryJob.session = force ? (uint32_t)random(1, 0x7fffffff) : discoverySession;
+
+  SpaADInformationTemplate &spa = discoveryJob.spa;
   spa.spaName = config.SpaName.getValue();
   spa.spaSerialNumber = spaSerialNumber;
   spa.stateTopic = mqttStatusTopic;
@@ -147,381 +427,332 @@ void mqttHaAutoDiscovery() {
   spa.model = xstr(PIOENV);
   spa.sw_version = xstr(BUILD_INFO);
   spa.configuration_url = "http://" + wifi.localIP().toString();
-
-  //sensorADPublish("Water Temperature","","temperature",mqttStatusTopic,"°C","{{ value_json.temperatures.water }}","measurement","WaterTemperature", spaName, spaSerialNumber);
-  //sensorADPublish("Heater Temperature","diagnostic","temperature",mqttStatusTopic,"°C","{{ value_json.temperatures.heater }}","measurement","HeaterTemperature", spaName, spaSerialNumber);
-  //sensorADPublish("Case Temperature","diagnostic","temperature",mqttStatusTopic,"°C","{{ value_json.temperatures.case }}","measurement","CaseTemperature", spaName, spaSerialNumber);
-  //sensorADPublish("Mains Voltage","diagnostic","voltage",mqttStatusTopic,"V","{{ value_json.power.voltage }}","measurement","MainsVoltage", spaName, spaSerialNumber);
-  //sensorADPublish("Mains Current","diagnostic","current",mqttStatusTopic,"A","{{ value_json.power.current }}","measurement","MainsCurrent", spaName, spaSerialNumber);
-  //sensorADPublish("Power","","energy",mqttStatusTopic,"W","{{ value_json.power.energy }}","measurement","Power", spaName, spaSerialNumber);
-  //sensorADPublish("Total Energy","","energy",mqttStatusTopic,"Wh","{{ value_json.totalenergy }}","total_increasing","TotalEnergy", spaName, spaSerialNumber);
-  //sensorADPublish("Heatpump Ambient Temperature","","temperature",mqttStatusTopic,"°C","{{ value_json.temperatures.heatpumpAmbient }}","measurement","HPAmbTemp", spaName, spaSerialNumber);
-  //sensorADPublish("Heatpump Condensor Temperature","","temperature",mqttStatusTopic,"°C","{{ value_json.temperatures.heatpumpCondensor }}","measurement","HPCondTemp", spaName, spaSerialNumber);
-  //sensorADPublish("State","","",mqttStatusTopic,"","{{ value_json.status.state }}","","State", spaName, spaSerialNumber);
   spa.commandTopic = mqttSet;
-  
-  AutoDiscoveryInformationTemplate ADConf;
-
-  ADConf.displayName = "Water Temperature";
-  ADConf.valueTemplate = "{{ value_json.temperatures.water }}";
-  ADConf.propertyId = "WaterTemperature";
-  ADConf.deviceClass = "temperature";
-  ADConf.entityCategory = "";
-  generateSensorAdJSON(output, ADConf, spa, discoveryTopic, "measurement", "°C");
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Case Temperature";
-  ADConf.valueTemplate = "{{ value_json.temperatures.case }}";
-  ADConf.propertyId = "CaseTemperature";
-  ADConf.deviceClass = "temperature";
-  ADConf.entityCategory = "diagnostic";
-  generateSensorAdJSON(output, ADConf, spa, discoveryTopic, "measurement", "°C");
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Heater Temperature";
-  ADConf.valueTemplate = "{{ value_json.temperatures.heater }}";
-  ADConf.propertyId = "HeaterTemperature";
-  ADConf.deviceClass = "temperature";
-  ADConf.entityCategory = "diagnostic";
-  generateSensorAdJSON(output, ADConf, spa, discoveryTopic, "measurement", "°C");
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Mains Voltage";
-  ADConf.valueTemplate = "{{ value_json.power.voltage }}";
-  ADConf.propertyId = "MainsVoltage";
-  ADConf.deviceClass = "voltage";
-  ADConf.entityCategory = "diagnostic";
-  generateSensorAdJSON(output, ADConf, spa, discoveryTopic, "measurement", "V");
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Mains Current";
-  ADConf.valueTemplate = "{{ value_json.power.current }}";
-  ADConf.propertyId = "MainsCurrent";
-  ADConf.deviceClass = "current";
-  ADConf.entityCategory = "diagnostic";
-  generateSensorAdJSON(output, ADConf, spa, discoveryTopic, "measurement", "A");
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Power";
-  ADConf.valueTemplate = "{{ value_json.power.power }}";
-  ADConf.propertyId = "Power";
-  ADConf.deviceClass = "power";
-  ADConf.entityCategory = "diagnostic";
-  generateSensorAdJSON(output, ADConf, spa, discoveryTopic, "measurement", "W");
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Total Energy";
-  ADConf.valueTemplate = "{{ value_json.power.totalenergy }}";
-  ADConf.propertyId = "TotalEnergy";
-  ADConf.deviceClass = "energy";
-  ADConf.entityCategory = "diagnostic";
-  generateSensorAdJSON(output, ADConf, spa, discoveryTopic, "measurement", "kWh");
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "State";
-  ADConf.valueTemplate = "{{ value_json.status.state }}";
-  ADConf.propertyId = "State";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "";
-  generateSensorAdJSON(output, ADConf, spa, discoveryTopic);
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  //binarySensorADPublish("Heating Active","",mqttStatusTopic,"{{ value_json.status.heatingActive }}","HeatingActive", spaName, spaSerialNumber);
-  //binarySensorADPublish("Ozone Active","",mqttStatusTopic,"{{ value_json.status.ozoneActive }}","OzoneActive", spaName, spaSerialNumber);
-  ADConf.displayName = "Heating Active";
-  ADConf.valueTemplate = "{{ value_json.status.heatingActive }}";
-  ADConf.propertyId = "HeatingActive";
-  ADConf.deviceClass = "heat";
-  ADConf.entityCategory = "";
-  generateBinarySensorAdJSON(output, ADConf, spa, discoveryTopic);
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Ozone Active";
-  ADConf.valueTemplate = "{{ value_json.status.ozoneActive }}";
-  ADConf.propertyId = "OzoneActive";
-  ADConf.deviceClass = "running";
-  ADConf.entityCategory = "";
-  generateBinarySensorAdJSON(output, ADConf, spa, discoveryTopic);
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  //climateADPublish(mqttClient, spa, spaName, "{{ value_json.temperatures }}", "Heating");
-  ADConf.displayName = "";
-  ADConf.valueTemplate = "{{ value_json.temperatures }}";
-  ADConf.propertyId = "Heating";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "";
-  generateClimateAdJSON(output, ADConf, spa, discoveryTopic);
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "";
-  const String* selectedPumpOptions = nullptr;
-  size_t arrSize = 0;
-  for (int pumpNumber = 1; pumpNumber <= 5; pumpNumber++) {
-    String pumpInstallState = (si.*(pumpInstallStateFunctions[pumpNumber - 1]))();
-    if (getPumpInstalledState(pumpInstallState) && getPumpPossibleStates(pumpInstallState).length() > 1) {
-      ADConf.displayName = "Pump " + String(pumpNumber);
-      ADConf.propertyId = "pump" + String(pumpNumber);
-      ADConf.valueTemplate = "{{ value_json.pumps.pump" + String(pumpNumber) + " }}";
-      if (pumpInstallState.endsWith("4")) {
-        selectedPumpOptions = si.autoPumpOptions.data();
-        arrSize = si.autoPumpOptions.size();
-      } else {
-        selectedPumpOptions = nullptr;
-        arrSize = 0;
-      }
-      if (getPumpSpeedType(pumpInstallState) == "1") {
-        generateFanAdJSON(output, ADConf, spa, discoveryTopic, 0, 0, selectedPumpOptions, arrSize);
-      } else {
-        generateFanAdJSON(output, ADConf, spa, discoveryTopic, getPumpSpeedMin(pumpInstallState), getPumpSpeedMax(pumpInstallState), selectedPumpOptions, arrSize);
+  spa.baseTopic = mqttBase.substring(0, mqttBase.length() - 1);
+  spa.abbreviate = config.MqttAbbreviateDiscovery.getValue();
+
+  runtimeStats.discoveryPending = discoveryEntityCount;
+
+  if (discoveryJob.deviceMode) generateDeviceAdJSON(discoveryJob.device, spa);  // components are added by mqttHaAutoDiscoveryStep
+}
+
+/// @brief Publish a discovery config unless it is the same as last time.
+///
+/// The document is hashed and measured through a HashPrint then streamed straight into the
+/// MQTT client, the payload is never held in memory.
+/// @param slot Index in discoveryHashes
+/// @param json Config to publish, nullptr publishes an empty config which removes the entity
+/// @return Bytes published
+size_t mqttPublishDiscoveryConfig(size_t slot, const char *topic, const JsonDocument *json) {
+  size_t topicLength = strlen(topic);
+  uint32_t hash = DISCOVERY_HASH_REMOVED;
+  size_t length = 0;
+  if (json != nullptr) {
+    HashPrint hashPrint(fnv1a(topic, topicLength));
+    serializeJson(*json, hashPrint);
+    hash = hashPrint.hash();
+    length = hashPrint.length();
+    if (hash == DISCOVERY_HASH_REMOVED || hash == DISCOVERY_HASH_UNKNOWN) hash = 1;
+  }
+  if (hash == discoveryHashes[slot] && !discoveryJob.force) {
+    discoveryJob.skipped++;
+    return 0;
+  }
+
+  // Streamed, the device config is larger than the PubSubClient buffer.
+  bool published = json != nullptr ? mqttClient.publishJson(topic, *json, true) : mqttClient.publish(topic, "", true);
+  if (published) {
+    if (discoveryHashes[slot] != hash) discoveryJob.hashesChanged = true;
+    discoveryHashes[slot] = hash;
+  } else {
+    discoveryHashes[slot] = DISCOVERY_HASH_UNKNOWN;  // try again next time
+    discoveryJob.hashesChanged = true;
+  }
+
+  discoveryJob.published++;
+  return topicLength + length;
+}
+
+/// @brief Publish the next few discovery configs, call from loop() while MQTT is connected.
+/// @return True when the run has just finished
+bool mqttHaAutoDiscoveryStep() {
+  if (!discoveryJob.active) return false;
+
+  // Reused for every config, topics never touch the heap.
+  static char discoveryTopic[AD_TOPIC_SIZE];
+  AutoDiscoveryRuntime runtime;
+  size_t bytes = 0;
+
+  // Switching modes - remove the other form first so Home Assistant never sees an entity twice.
+  if (discoveryJob.next == 0 && !discoveryJob.deviceMode && discoveryHashes[DISCOVERY_DEVICE_SLOT] != DISCOVERY_HASH_REMOVED) {
+    adDeviceDiscoveryTopic(discoveryTopic, sizeof(discoveryTopic), discoveryJob.spa);
+    bytes += mqttPublishDiscoveryConfig(DISCOVERY_DEVICE_SLOT, discoveryTopic, nullptr);
+  }
+
+  // Rows dropped from the table by a firmware update, remove their entities.
+  while (discoveryJob.next == 0 && !discoveryRetired.empty()) {
+    const String &id = discoveryRetired.back();
+    int separator = id.indexOf('/');
+    bytes += adDiscoveryTopic(discoveryTopic, sizeof(discoveryTopic), discoveryJob.spa,
+      id.substring(0, separator).c_str(), id.c_str() + separator + 1);
+    debugI("Removing discovery config %s", discoveryTopic);
+    mqttClient.publish(discoveryTopic, "", true);
+    discoveryRetired.pop_back();
+  }
+
+  for (int entities = 0; entities < DISCOVERY_ENTITIES_PER_LOOP && bytes < DISCOVERY_BYTES_PER_LOOP
+       && discoveryJob.next < discoveryEntityCount; entities++) {
+    size_t i = discoveryJob.next++;
+    const AutoDiscoveryEntity &entity = discoveryEntities[i];
+    if (discoveryJob.capabilities != 0 && (discoveryEntityCapabilities(entity) & discoveryJob.capabilities) == 0) continue;
+    bool present = resolveDiscoveryEntity(entity, runtime);
+    if (!present && discoveryHashes[i] == DISCOVERY_HASH_REMOVED && !discoveryJob.force && !discoveryJob.deviceMode) continue;
+
+    size_t topicLength = adDiscoveryTopic(discoveryTopic, sizeof(discoveryTopic), discoveryJob.spa,
+      adComponentName(entity.component), entity.propertyId);
+
+    if (!present) {
+      // An empty retained config removes the entity, no config is generated for it
+      if (!discoveryJob.deviceMode || discoveryHashes[i] != DISCOVERY_HASH_REMOVED) {
+        bytes += mqttPublishDiscoveryConfig(i, discoveryTopic, nullptr);
       }
-      mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
+      if (discoveryJob.deviceMode) removeDeviceComponentAdJSON(discoveryJob.device, entity.component, entity.propertyId, discoveryJob.spa);
+      continue;
     }
+
+    JsonDocument json;
+    JsonDocument compact;
+    generateEntityAdJSON(json, entity, discoveryJob.spa, runtime);
+    const JsonDocument &payload = compactAdJSON(json, discoveryJob.spa, compact);
+
+    if (!discoveryJob.deviceMode) {
+      bytes += mqttPublishDiscoveryConfig(i, discoveryTopic, &payload);
+      continue;
+    }
+
+    if (discoveryHashes[i] != DISCOVERY_HASH_REMOVED) bytes += mqttPublishDiscoveryConfig(i, discoveryTopic, nullptr);
+    discoveryJob.entityModeBytes += topicLength + measureJson(payload);
+    addDeviceComponentAdJSON(discoveryJob.device, json, entity.component, discoveryJob.spa);
   }
 
-  if (si.getHP_Present()) {
-    ADConf.displayName = "Heatpump Ambient Temperature";
-    ADConf.valueTemplate = "{{ value_json.temperatures.heatpumpAmbient }}";
-    ADConf.propertyId = "HPAmbTemp";
-    ADConf.deviceClass = "temperature";
-    ADConf.entityCategory = "diagnostic";
-    generateSensorAdJSON(output, ADConf, spa, discoveryTopic, "measurement", "°C");
-    mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-    ADConf.displayName = "Heatpump Condensor Temperature";
-    ADConf.valueTemplate = "{{ value_json.temperatures.heatpumpCondensor }}";
-    ADConf.propertyId = "HPCondTemp";
-    ADConf.deviceClass = "temperature";
-    ADConf.entityCategory = "diagnostic";
-    generateSensorAdJSON(output, ADConf, spa, discoveryTopic, "measurement", "°C");
-    mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-    //selectADPublish(mqttClient, spa, "Heatpump Mode", "{{ value_json.heatpump.mode }}", "heatpump_mode", "", "", {"Auto","Heat","Cool","Off"});
-    ADConf.displayName = "Heatpump Mode";
-    ADConf.valueTemplate = "{{ value_json.heatpump.mode }}";
-    ADConf.propertyId = "heatpump_mode";
-    ADConf.deviceClass = "";
-    ADConf.entityCategory = "";
-    generateSelectAdJSON(output, ADConf, spa, discoveryTopic, si.HPMPStrings);
-    mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-    //switchADPublish(mqttClient, spa, "Aux Heat Element", "{{ value_json.heatpump.auxheat }}", "heatpump_auxheat");
-    ADConf.displayName = "Aux Heat Element";
-    ADConf.valueTemplate = "{{ value_json.heatpump.auxheat }}";
-    ADConf.propertyId = "heatpump_auxheat";
-    ADConf.deviceClass = "";
-    ADConf.entityCategory = "";
-    generateSwitchAdJSON(output, ADConf, spa, discoveryTopic);
-    mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-  }
-
-  //lightADPublish(mqttClient, spa, "Lights", "{{ value_json.lights }}", "lights", "", "", colorModeStrings);
-  ADConf.displayName = "Lights";
-  ADConf.valueTemplate = "{{ value_json.lights }}";
-  ADConf.propertyId = "lights";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "";
-  generateLightAdJSON(output, ADConf, spa, discoveryTopic, si.colorModeStrings);
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  //selectADPublish(mqttClient, spa, "Lights Speed","{{ value_json.lights.speed }}","lights_speed", "", "", {"1","2","3","4","5"});
-  ADConf.displayName = "Lights Speed";
-  ADConf.valueTemplate = "{{ value_json.lights.speed }}";
-  ADConf.propertyId = "lights_speed";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "";
-  generateSelectAdJSON(output, ADConf, spa, discoveryTopic, si.lightSpeedMap );
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  //selectADPublish(mqttClient, spa, "Sleep Timer 1","{{ value_json.sleepTimers.timer1.state }}", "sleepTimers_1_state", "config", "", sleepStrings);
-  //selectADPublish(mqttClient, spa, "Sleep Timer 2","{{ value_json.sleepTimers.timer2.state }}", "sleepTimers_2_state", "config", "", sleepStrings);
-  ADConf.displayName = "Sleep Timer 1";
-  ADConf.valueTemplate = "{{ value_json.sleepTimers.timer1.state }}";
-  ADConf.propertyId = "sleepTimers_1_state";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "config";
-  generateSelectAdJSON(output, ADConf, spa, discoveryTopic, si.sleepSelection);
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Sleep Timer 2";
-  ADConf.valueTemplate = "{{ value_json.sleepTimers.timer2.state }}";
-  ADConf.propertyId = "sleepTimers_2_state";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "config";
-  generateSelectAdJSON(output, ADConf, spa, discoveryTopic, si.sleepSelection);
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Date Time";
-  ADConf.valueTemplate = "{{ value_json.status.datetime }}";
-  ADConf.propertyId = "status_datetime";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "config";
-  generateTextAdJSON(output, ADConf, spa, discoveryTopic, "[0-9]{4}-[0-9]{2}-[0-9]{2} [0-9]{2}:[0-9]{2}");
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Sleep Timer 1 Begin";
-  ADConf.valueTemplate = "{{ value_json.sleepTimers.timer1.begin }}";
-  ADConf.propertyId = "sleepTimers_1_begin";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "config";
-  generateTextAdJSON(output, ADConf, spa, discoveryTopic, "[0-2][0-9]:[0-9]{2}");
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Sleep Timer 1 End";
-  ADConf.valueTemplate = "{{ value_json.sleepTimers.timer1.end }}";
-  ADConf.propertyId = "sleepTimers_1_end";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "config";
-  generateTextAdJSON(output, ADConf, spa, discoveryTopic, "[0-2][0-9]:[0-9]{2}");
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Sleep Timer 2 Begin";
-  ADConf.valueTemplate = "{{ value_json.sleepTimers.timer2.begin }}";
-  ADConf.propertyId = "sleepTimers_2_begin";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "config";
-  generateTextAdJSON(output, ADConf, spa, discoveryTopic, "[0-2][0-9]:[0-9]{2}");
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  ADConf.displayName = "Sleep Timer 2 End";
-  ADConf.valueTemplate = "{{ value_json.sleepTimers.timer2.end }}";
-  ADConf.propertyId = "sleepTimers_2_end";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "config";
-  generateTextAdJSON(output, ADConf, spa, discoveryTopic, "[0-2][0-9]:[0-9]{2}");
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  //fanADPublish(mqttClient, spa, "Blower", "{{ value_json.blower }}", "blower");
-  ADConf.displayName = "Blower";
-  ADConf.valueTemplate = "{{ value_json.blower }}";
-  ADConf.propertyId = "blower";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "";
-  generateFanAdJSON(output, ADConf, spa, discoveryTopic, 1, 5, si.blowerStrings.data(), si.blowerStrings.size());
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
-
-  //selectADPublish(mqttClient, spa, "Spa Mode", "{{ value_json.status.spaMode }}", "status_spaMode", "", "", spaModeStrings);
-  ADConf.displayName = "Spa Mode";
-  ADConf.valueTemplate = "{{ value_json.status.spaMode }}";
-  ADConf.propertyId = "status_spaMode";
-  ADConf.deviceClass = "";
-  ADConf.entityCategory = "";
-  generateSelectAdJSON(output, ADConf, spa, discoveryTopic, si.spaModeStrings);
-  mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
+  // The device config is a single message that can be larger than DISCOVERY_BYTES_PER_LOOP on its own,
+  // so it is exempt from the budget but gets a pass to itself rather than following the last rows.
+  bool devicePending = discoveryJob.deviceMode && discoveryJob.next == discoveryEntityCount;
+  if (devicePending && bytes == 0) {
+    devicePending = false;
+    unsigned long start = millis();
+    adDeviceDiscoveryTopic(discoveryTopic, sizeof(discoveryTopic), discoveryJob.spa);
+    JsonDocument compact;
+    const JsonDocument &payload = compactAdJSON(discoveryJob.device, discoveryJob.spa, compact);
+    size_t deviceBytes = strlen(discoveryTopic) + measureJson(payload);
+    bytes += mqttPublishDiscoveryConfig(DISCOVERY_DEVICE_SLOT, discoveryTopic, &payload);
+    discoveryJob.device.clear();
+    debugI("Device discovery config is %u bytes (%u as separate entity configs), serialized and sent in %lu ms",
+      deviceBytes, discoveryJob.entityModeBytes, millis() - start);
+  }
 
+  discoveryJob.bytes += bytes;
+  runtimeStats.discoveryPending = discoveryEntityCount - discoveryJob.next;
+  debugV("Auto discovery %u of %u entities", discoveryJob.next, discoveryEntityCount);
+  if (discoveryJob.next < discoveryEntityCount || devicePending) return false;
+
+  bool newSession = discoveryJob.session != discoverySession;
+  discoverySession = discoveryJob.session;
+  if (discoveryJob.hashesChanged || discoverySlotsChanged || newSession) saveDiscoveryState();
+  if (newSession) {
+    char id[9];
+    snprintf(id, sizeof(id), "%08lx", (unsigned long)discoverySession);
+    if (mqttClient.publish(mqttDiscoverySession.c_str(), id, true)) discoveryBrokerSession = discoverySession;
+  }
+  discoveryJob.active = false;
+
+  runtimeStats.discoveryMillis = millis() - discoveryJob.start;
+  runtimeStats.discoveryBytes = discoveryJob.bytes;
+  debugI("Auto discovery published %i entities (%i unchanged), %u bytes in %lu ms",
+    discoveryJob.published, discoveryJob.skipped, discoveryJob.bytes, runtimeStats.discoveryMillis);
+  return true;
+}
+
+/// @brief SpaInterface capabilities callback - a pump was (un)installed or the heat pump appeared.
+///
+/// Only the affected entities are refreshed, once any discovery run in progress has finished.
+void mqttCapabilitiesChanged(uint8_t changed) {
+  debugI("Spa capabilities changed (0x%02x)", changed);
+  discoveryCapabilityChanges |= changed;
 }
 
 #pragma region MQTT Publish / Subscribe
 
 void mqttPublishStatusString(String s){
 
-  mqttClient.publish(String(mqttBase+"rfResponse").c_str(),s.c_str());
+  // The raw response is larger than the PubSubClient buffer, write it straight to the socket.
+  mqttClient.publishPayload(String(mqttBase+"rfResponse").c_str(), s);
 
 }
 
-void mqttPublishStatus() {
-  String json;
-  if (generateStatusJson(si, mqttClient, json, false)) {
-    mqttClient.publish(mqttStatusTopic.c_str(),json.c_str());
+/// @brief Publish what changed since the last delta as a JSON merge patch on status/delta.
+/// The whole document goes out every MqttFullStatusInterval minutes and after a reconnect so subscribers can resync.
+void mqttPublishStatusDelta(const JsonDocument &current) {
+  bool success;
+  if (statusDeltaFullDue || millis() - statusDeltaLastFull >= (ulong)config.MqttFullStatusInterval.getValue() * 60000) {
+    success = mqttClient.publishJson(mqttStatusDeltaTopic.c_str(), current);
+    statusDeltaLastFull = millis();
   } else {
-    debugD("Error generating json");
+    JsonDocument delta;
+    if (!generateStatusDelta(statusDeltaBaseline, current, delta.to<JsonObject>())) return;  // nothing changed
+    success = mqttClient.publishJson(mqttStatusDeltaTopic.c_str(), delta);
+    debugV("Published status delta, %u of %u bytes", measureJson(delta), measureJson(current));
   }
+
+  // A lost delta would leave subscribers out of step, so start again from a full document.
+  statusDeltaFullDue = !success;
+  statusDeltaBaseline = current;
 }
 
+// Property topics are published a few per loop() pass, a changed status must not hold up the loop.
+#ifndef PROPERTY_TOPICS_PER_LOOP
+  #define PROPERTY_TOPICS_PER_LOOP 8
+#endif
+#ifndef PROPERTY_TOPIC_SIZE
+  #define PROPERTY_TOPIC_SIZE 128
+#endif
 
-void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  String t = String(topic);
-
-  String p = "";
-  for (uint x = 0; x < length; x++) {
-    p += char(*payload);
-    payload++;
-  }
-
-  debugD("MQTT subscribe received '%s' with payload '%s'",topic,p.c_str());
-
-  String property = t.substring(t.lastIndexOf("/")+1);
-
-  debugI("Received update for %s to %s",property.c_str(),p.c_str());
-
-  if (property == "temperatures_setPoint") {
-    si.setSTMP(int(p.toFloat()*10));
-  } else if (property == "heatpump_mode") {
-    si.setHPMP(p);
-  // note single speed pumps should never trigger a mode or speed events
-  } else if (property.startsWith("pump") && property.endsWith("_speed")) {
-    int pumpNum = property.charAt(4) - '0';
-    // p = 1 = Off, p = 2 = Low, p = 3 = High
-    // send values need to be changed to the appropriate values
-    if (p == "1") p = "0";
-    else if (p == "2") p = "3";
-    else if (p == "3") p = "2";
-    (si.*(setPumpFunctions[pumpNum-1]))(p.toInt());
-  } else if (property.startsWith("pump") && property.endsWith("_mode")) {
-    int pumpNum = property.charAt(4) - '0';
-    if (p == "Auto") (si.*(setPumpFunctions[pumpNum-1]))(4);
-    else (si.*(setPumpFunctions[pumpNum-1]))(3); // When we change mode to manual set speed to low, as this matches the auto display speed
-  } else if (property.startsWith("pump") && property.endsWith("_state")) {
-    int pumpNum = property.charAt(4) - '0';
-    String pumpState = (si.*(pumpInstallStateFunctions[pumpNum-1]))();
-    if (getPumpSpeedType(pumpState) == "2") (si.*(setPumpFunctions[pumpNum-1]))(p=="OFF"?0:2); // When we turn on the pump use speed high
-    else (si.*(setPumpFunctions[pumpNum-1]))(p=="OFF"?0:1);
-  } else if (property == "heatpump_auxheat") {
-    si.setHELE(p=="OFF"?0:1);
-  } else if (property == "status_datetime") {
-    tmElements_t tm;
-    tm.Year=CalendarYrToTm(p.substring(0,4).toInt());
-    tm.Month=p.substring(5,7).toInt();
-    tm.Day=p.substring(8,10).toInt();
-    tm.Hour=p.substring(11,13).toInt();
-    tm.Minute=p.substring(14,16).toInt();
-    tm.Second=p.substring(17).toInt();
-    si.setSpaTime(makeTime(tm));
-  } else if (property == "lights_state") {
-    si.setRB_TP_Light(p=="ON"?1:0);
-  } else if (property == "lights_effect") {
-    si.setColorMode(p);
-  } else if (property == "lights_brightness") {
-    si.setLBRTValue(p.toInt());
-  } else if (property == "lights_color") {
-    int pos = p.indexOf(',');
-    if ( pos > 0) {
-      int value = p.substring(0, pos).toInt();
-      si.setCurrClr(si.colorMap[value/15]);
+/// @brief Publish and remove leaves of pending as retained scalars, null leaves publish an empty payload.
+/// @param topic Holds the topic of pending in its first length characters, the leaf names are appended
+/// @return Leaves published
+size_t mqttPublishPropertyLeaves(JsonObject pending, char *topic, size_t length, size_t budget) {
+  size_t published = 0;
+  while (published < budget && length < PROPERTY_TOPIC_SIZE - 1) {
+    auto first = pending.begin();
+    if (first == pending.end()) break;
+    JsonPair member = *first;
+
+    int keyLength = snprintf(topic + length, PROPERTY_TOPIC_SIZE - length, "%s", member.key().c_str());
+    size_t end = min(length + max(keyLength, 0), (size_t)PROPERTY_TOPIC_SIZE - 1);
+    JsonVariant value = member.value();
+
+    if (value.is<JsonObject>()) {
+      topic[end] = '/';
+      published += mqttPublishPropertyLeaves(value.as<JsonObject>(), topic, end + 1, budget - published);
+      if (value.as<JsonObject>().size() > 0) break;  // out of budget, carry on next pass
+      pending.remove(member.key());
+      continue;
     }
-  } else if (property == "lights_speed") {
-    si.setLSPDValue(p);
-  } else if (property == "blower_state") {
-    si.setOutlet_Blower(p=="OFF"?2:0);
-  } else if (property == "blower_speed") {
-    if (p=="0") si.setOutlet_Blower(2);
-    else si.setVARIValue(p.toInt());
-  } else if (property == "blower_mode") {
-    si.setOutlet_Blower(p=="Variable"?0:1);
-  } else if (property == "sleepTimers_1_state" || property == "sleepTimers_2_state") {
-    int member=0;
-    for (const auto& i : si.sleepSelection) {
-      if (i == p) {
-        if (property == "sleepTimers_1_state")
-          si.setL_1SNZ_DAY(si.sleepBitmap[member]);
-        else if (property == "sleepTimers_2_state")
-          si.setL_2SNZ_DAY(si.sleepBitmap[member]);
-        break;
-      }
-      member++;
+
+    char buffer[32];
+    const char *payload = "";
+    if (value.is<const char*>()) payload = value.as<const char*>();
+    else if (!value.isNull()) {
+      serializeJson(value, buffer, sizeof(buffer));
+      payload = buffer;
     }
-  } else if (property == "sleepTimers_1_begin") {
-    si.setL_1SNZ_BGN(convertToInteger(p));
-  } else if (property == "sleepTimers_1_end") {
-    si.setL_1SNZ_END(convertToInteger(p));
-  } else if (property == "sleepTimers_2_begin") {
-    si.setL_2SNZ_BGN(convertToInteger(p));
-  } else if (property == "sleepTimers_2_end") {
-    si.setL_2SNZ_END(convertToInteger(p));
-  } else if (property == "status_spaMode") {
-    si.setMode(p);
-  } else {
-    debugE("Unhandled property - %s",property.c_str());
+    mqttClient.publish(topic, payload, true);
+    pending.remove(member.key());
+    published++;
+  }
+  return published;
+}
+
+/// @brief Publish the next few queued property topics, call from loop() while MQTT is connected.
+void mqttPropertyTopicsStep() {
+  JsonObject pending = propertyTopicsPending.as<JsonObject>();
+  if (pending.isNull()) return;
+
+  // Reused for every topic, topics never touch the heap.
+  static char topic[PROPERTY_TOPIC_SIZE];
+  size_t length = snprintf(topic, sizeof(topic), "%sproperty/", mqttBase.c_str());
+  mqttPublishPropertyLeaves(pending, topic, min(length, sizeof(topic) - 1), PROPERTY_TOPICS_PER_LOOP);
+  if (pending.size() == 0) propertyTopicsPending.clear();
+}
+
+/// @brief Queue an empty payload for every leaf of published, which removes the retained topics.
+void mqttClearPropertyTopics(JsonObjectConst published, JsonObject pending) {
+  for (JsonPairConst member : published) {
+    if (member.value().is<JsonObjectConst>()) {
+      auto existing = pending[member.key()];
+      mqttClearPropertyTopics(member.value(), existing.is<JsonObject>() ? existing.as<JsonObject>() : existing.to<JsonObject>());
+    } else {
+      pending[member.key()] = nullptr;
+    }
+  }
+}
+
+/// @brief Keep the per property topics in step with the status, only the leaves that changed are queued.
+void mqttUpdatePropertyTopics(const JsonDocument &current) {
+  JsonObject pending = propertyTopicsPending.as<JsonObject>();
+  if (pending.isNull()) pending = propertyTopicsPending.to<JsonObject>();
+
+  if (!config.MqttPropertyTopics.getValue()) {
+    if (propertyTopicsBaseline.isNull()) return;
+    // Turned off, remove the retained topics that were published.
+    mqttClearPropertyTopics(propertyTopicsBaseline.as<JsonObjectConst>(), pending);
+    propertyTopicsBaseline.clear();
+    return;
+  }
+
+  JsonDocument delta;
+  if (generateStatusDelta(propertyTopicsBaseline, current, delta.to<JsonObject>())) {
+    mergeStatusDelta(pending, delta.as<JsonObjectConst>());
+  }
+  propertyTopicsBaseline = current;
+}
+
+void mqttPublishStatus() {
+  // The status is serialized once per frame into the String cached for /json and its ETag, that String
+  // is written straight to the socket, bypassing the PubSubClient buffer.  Streaming from the document
+  // instead would serialize it a second time.
+  const String &json = statusCache.get();
+  if (json.isEmpty()) {
+    debugD("Error generating json");
+    return;
+  }
+  if (!mqttClient.publishPayload(mqttStatusTopic.c_str(), json)) debugW("Failed to publish status");
+
+  if (!config.MqttDeltaStatus.getValue() && !config.MqttPropertyTopics.getValue() && !config.MqttMsgPackStatus.getValue()
+      && propertyTopicsBaseline.isNull()) return;
+
+  // The document the JSON above was serialized from, not a parse of it.
+  const JsonDocument *current = statusCache.getDocument();
+  if (current == nullptr) return;
+
+  if (config.MqttMsgPackStatus.getValue()) {
+    if (!mqttClient.publishMsgPack(mqttStatusMsgPackTopic.c_str(), *current)) debugW("Failed to publish MessagePack status");
+  }
+  if (config.MqttDeltaStatus.getValue()) mqttPublishStatusDelta(*current);
+  mqttUpdatePropertyTopics(*current);
+}
+
+void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  if (strcmp(topic, HA_STATUS_TOPIC) == 0) {
+    if (length == 6 && memcmp(payload, "online", 6) == 0) {
+      haBirthAt = millis() + random(HA_BIRTH_SPREAD);
+      haBirthPending = true;
+      debugI("Home Assistant online, republishing in %li ms", (long)(haBirthAt - millis()));
+    }
+    return;
+  }
+
+  if (mqttDiscoverySession == topic) {
+    char id[9] = {};
+    if (length == 8) memcpy(id, payload, 8);
+    discoveryBrokerSession = strtoul(id, nullptr, 16);
+    discoveryBrokerSessionReceived = true;
+    debugD("Discovery session on the broker is %08lx", (unsigned long)discoveryBrokerSession);
+    return;
+  }
+
+  // The payload is parsed where it lies in the client's buffer, it is not NUL terminated.
+  StringView value = {(const char *)payload, length};
+
+  debugD("MQTT subscribe received '%s' with payload '%.*s'",topic,(int)length,value.data);
+
+  const char *property = strrchr(topic, '/');
+  property = property == nullptr ? topic : property + 1;
+
+  debugI("Received update for %s to %.*s",property,(int)length,value.data);
+
+  if (!applySpaCommand(si, lookupSpaCommand(property, strlen(property)), value)) {
+    debugE("Unhandled property or invalid value - %s",property);
   }
 }
 
@@ -596,22 +827,43 @@ void setup() {
 
   mqttClient.setServer(config.MqttServer.getValue(), config.MqttPort.getValue());
   mqttClient.setCallback(mqttCallback);
-  mqttClient.setBufferSize(2048);
+  // Status, discovery configs and the RF response bypass the buffer (publishPayload / publishJson), so
+  // it only holds inbound commands and the short availability, property and removal messages.
+  mqttClient.setBufferSize(512);
 
   bootStartMillis = millis();  // Record the current boot time in milliseconds
+  runtimeStats.bootMillis = bootStartMillis;
+
+  history.begin();
+  influx.setChangedOnly(config.InfluxChangedOnly.getValue());
+  influx.setServer(config.InfluxHost.getValue(), config.InfluxPort.getValue());
 
   ui.begin();
   ui.setWifiManagerCallback(startWifiManagerCallback);
+  ui.setHistory(&history);
+  ui.setStatusCache(&statusCache);
+  ui.setRuntimeStatistics(&runtimeStats);
   si.setUpdateFrequency(config.UpdateFrequency.getValue());
+  si.setPublishPolicy(config.PublishMinInterval.getValue(), config.PublishHeartbeat.getValue());
+  si.setStatisticsWindow(config.StatisticsWindow.getValue());
 
   config.setCallback(configChangeCallbackString);
   config.setCallback(configChangeCallbackInt);
+  config.setCallback(configChangeCallbackBool);
 
 }
 
 
 
+void loopBody();
+
 void loop() {  
+  unsigned long loopStart = micros();
+  loopBody();
+  runtimeStats.addLoop(micros() - loopStart);
+}
+
+void loopBody() {
   checkButton();
   
   mqttClient.loop();
@@ -644,6 +896,15 @@ void loop() {
 
       si.loop();
 
+      if (si.getSnapshotVersion() != historySnapshotVersion) {  // new frame decoded
+        historySnapshotVersion = si.getSnapshotVersion();
+        SpaStatusSnapshot snapshot;
+        si.getSnapshot(snapshot);
+        history.record(snapshot);
+        if (spaSerialNumber != "") influx.exportFrame(si);
+      }
+      influx.loop();
+
       if (si.isInitialised()) {
         if ( spaSerialNumber=="" ) {
           debugI("Initialising...");
@@ -651,10 +912,15 @@ void loop() {
           spaSerialNumber = si.getSerialNo1()+"-"+si.getSerialNo2();
           debugI("Spa serial number is %s",spaSerialNumber.c_str());
 
+          influx.setSerialNumber(spaSerialNumber);
+
           mqttBase = String("sn_esp32/") + spaSerialNumber + String("/");
           mqttStatusTopic = mqttBase + "status";
+          mqttStatusDeltaTopic = mqttStatusTopic + "/delta";
+          mqttStatusMsgPackTopic = mqttStatusTopic + "/msgpack";
           mqttSet = mqttBase + "set";
           mqttAvailability = mqttBase+"available";
+          mqttDiscoverySession = mqttBase+"discovery";
           debugI("MQTT base topic is %s",mqttBase.c_str());
         }
         if (!mqttClient.connected()) {  // MQTT broker reconnect if not connected
@@ -668,29 +934,59 @@ void loop() {
 
             if (mqttClient.connect("sn_esp32", config.MqttUsername.getValue(), config.MqttPassword.getValue(), mqttAvailability.c_str(),2,true,"offline")) {
               debugI("MQTT connected");
+              runtimeStats.mqttConnects++;
     
               String subTopic = mqttBase+"set/#";
               debugI("Subscribing to topic %s", subTopic.c_str());
               mqttClient.subscribe(subTopic.c_str());
+              mqttClient.subscribe(HA_STATUS_TOPIC);
+              mqttClient.subscribe(mqttDiscoverySession.c_str());
+              discoveryBrokerSession = 0;
+              discoveryBrokerSessionReceived = false;
+              discoverySessionDeadline = millis() + DISCOVERY_SESSION_TIMEOUT;
 
               mqttClient.publish(mqttAvailability.c_str(),"online",true);
               autoDiscoveryPublished = false;
+              statusDeltaFullDue = true;
+              propertyTopicsBaseline.clear();  // republish every property topic
             } else {
               debugW("MQTT connection failed");
+              runtimeStats.mqttConnectFailures++;
             }
 
           }
         } else {
-          if (!autoDiscoveryPublished) {  // This is the setup area, gets called once when communication with Spa and MQTT broker have been established.
+          // This is the setup area, gets called once when communication with Spa and MQTT broker have been
+          // established and the broker has sent the retained discovery session (or had none to send).
+          if (!autoDiscoveryPublished && (discoveryBrokerSessionReceived || (long)(millis() - discoverySessionDeadline) >= 0)) {
             debugI("Publish autodiscovery information");
             mqttHaAutoDiscovery();
             autoDiscoveryPublished = true;
             si.setUpdateCallback(mqttPublishStatus);
-            mqttPublishStatus();
+            si.setCapabilitiesCallback(mqttCapabilitiesChanged);
+            discoveryCapabilityChanges = 0;  // the full run covers them
 
             si.statusResponse.setCallback(mqttPublishStatusString);
 
           }
+
+          // Publish the status once every entity is known so they all show a value straight away.
+          if (mqttHaAutoDiscoveryStep()) mqttPublishStatus();
+          mqttPropertyTopicsStep();
+
+          // Home Assistant restarted - it gets the retained discovery configs from the broker, but needs
+          // the state.  Discovery is rerun hash checked, so only configs that changed are sent.
+          if (haBirthPending && (long)(millis() - haBirthAt) >= 0) {
+            haBirthPending = false;
+            mqttClient.publish(mqttAvailability.c_str(),"online",true);
+            mqttPublishStatus();
+            if (!discoveryJob.active && autoDiscoveryPublished) mqttHaAutoDiscovery();
+          }
+
+          if (discoveryCapabilityChanges != 0 && !discoveryJob.active && autoDiscoveryPublished) {
+            mqttHaAutoDiscovery(false, discoveryCapabilityChanges);
+            discoveryCapabilityChanges = 0;
+          }
           
           // all systems are go! Start the knight rider animation loop
           blinker.setState(KNIGHT_RIDER);
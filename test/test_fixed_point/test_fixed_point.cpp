@@ -0,0 +1,123 @@
+#include <unity.h>
+#include "FixedPoint.h"
+
+void setUp() {}
+void tearDown() {}
+
+template <uint8_t Decimals>
+static int32_t parsed(const char *s) {
+    FixedPoint<Decimals> value = FixedPoint<Decimals>::fromRaw(-12345);
+    TEST_ASSERT_TRUE(FixedPoint<Decimals>::parse(s, value));
+    return value.raw();
+}
+
+template <uint8_t Decimals>
+static void assertRejected(const char *s) {
+    FixedPoint<Decimals> value = FixedPoint<Decimals>::fromRaw(-12345);
+    TEST_ASSERT_FALSE(FixedPoint<Decimals>::parse(s, value));
+    TEST_ASSERT_EQUAL(-12345, value.raw());  // left unchanged
+}
+
+template <uint8_t Decimals>
+static void assertChars(const char *expected, int32_t raw) {
+    char buffer[FixedPoint<Decimals>::maxChars];
+    size_t length = FixedPoint<Decimals>::fromRaw(raw).toChars(buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_STRING(expected, buffer);
+    TEST_ASSERT_EQUAL(strlen(expected), length);
+}
+
+void test_parse() {
+    TEST_ASSERT_EQUAL(385, parsed<1>("38.5"));
+    TEST_ASSERT_EQUAL(380, parsed<1>("38"));
+    TEST_ASSERT_EQUAL(380, parsed<1>("38."));
+    TEST_ASSERT_EQUAL(5, parsed<1>(".5"));
+    TEST_ASSERT_EQUAL(385, parsed<1>(" +38.5 "));
+    TEST_ASSERT_EQUAL(24350, parsed<2>("243.5"));
+    TEST_ASSERT_EQUAL(42, parsed<0>("42"));
+}
+
+void test_parse_negative() {
+    TEST_ASSERT_EQUAL(-5, parsed<1>("-0.5"));
+    TEST_ASSERT_EQUAL(-25, parsed<2>("-0.25"));
+    TEST_ASSERT_EQUAL(-120, parsed<1>("-12"));
+    TEST_ASSERT_EQUAL(0, parsed<1>("-0"));
+}
+
+void test_parse_rounding() {
+    // Extra decimals round half away from zero
+    TEST_ASSERT_EQUAL(385, parsed<1>("38.45"));
+    TEST_ASSERT_EQUAL(384, parsed<1>("38.44999"));
+    TEST_ASSERT_EQUAL(-3, parsed<1>("-0.25"));
+    TEST_ASSERT_EQUAL(100, parsed<1>("9.96"));
+    TEST_ASSERT_EQUAL(123, parsed<2>("1.23456789"));
+}
+
+void test_parse_overflow() {
+    TEST_ASSERT_EQUAL(INT32_MAX, parsed<0>("2147483647"));
+    assertRejected<0>("2147483648");
+    TEST_ASSERT_EQUAL(INT32_MAX, parsed<1>("214748364.7"));
+    assertRejected<1>("214748364.8");
+    assertRejected<1>("214748364.75");  // only over the limit once rounded
+    assertRejected<2>("99999999999999999999");
+}
+
+void test_parse_invalid() {
+    assertRejected<1>("");
+    assertRejected<1>(" ");
+    assertRejected<1>("-");
+    assertRejected<1>(".");
+    assertRejected<1>("38.5x");
+    assertRejected<1>("38.5.1");
+    assertRejected<1>("3 8");
+    assertRejected<1>("abc");
+}
+
+void test_parse_not_terminated() {
+    // An MQTT payload is not NUL terminated, only length characters are read
+    FixedPoint<1> value;
+    TEST_ASSERT_TRUE(FixedPoint<1>::parse("38.59999", 4, value));
+    TEST_ASSERT_EQUAL(385, value.raw());
+}
+
+void test_to_chars() {
+    assertChars<1>("38.5", 385);
+    assertChars<1>("0.5", 5);
+    assertChars<1>("-0.5", -5);
+    assertChars<1>("-12.0", -120);
+    assertChars<2>("0.00", 0);
+    assertChars<2>("243.50", 24350);
+    assertChars<0>("42", 42);
+    assertChars<0>("-2147483648", INT32_MIN);
+    assertChars<2>("-21474836.48", INT32_MIN);
+    assertChars<2>("21474836.47", INT32_MAX);
+}
+
+void test_to_chars_small_buffer() {
+    char buffer[4];
+    size_t length = FixedPoint<1>::fromRaw(12345).toChars(buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(3, length);
+    TEST_ASSERT_EQUAL('\0', buffer[3]);
+    TEST_ASSERT_EQUAL(0, FixedPoint<1>::fromRaw(1).toChars(buffer, 0));
+}
+
+void test_round_trip() {
+    for (int32_t raw = -1000; raw <= 1000; raw += 7) {
+        char buffer[FixedPoint<2>::maxChars];
+        FixedPoint<2>::fromRaw(raw).toChars(buffer, sizeof(buffer));
+        TEST_ASSERT_EQUAL(raw, parsed<2>(buffer));
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_parse);
+    RUN_TEST(test_parse_negative);
+    RUN_TEST(test_parse_rounding);
+    RUN_TEST(test_parse_overflow);
+    RUN_TEST(test_parse_invalid);
+    RUN_TEST(test_parse_not_terminated);
+    RUN_TEST(test_to_chars);
+    RUN_TEST(test_to_chars_small_buffer);
+    RUN_TEST(test_round_trip);
+    return UNITY_END();
+}
@@ -0,0 +1,164 @@
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "InfluxLine.h"
+
+struct PacketCollector : public InfluxPacketSink {
+    std::vector<std::string> packets;
+    void queuePacket(const InfluxPacket &packet) override {
+        packets.push_back(std::string(packet.data, packet.length));
+    }
+    std::string joined() const {
+        std::string all;
+        for (const std::string &packet : packets) all += packet;
+        return all;
+    }
+};
+
+static const char *timestamp = "1735689600000000000";
+
+void setUp() {}
+void tearDown() {}
+
+void test_single_line() {
+    PacketCollector sink;
+    InfluxLineWriter writer(sink);
+    writer.beginFrame(timestamp);
+    writer.startLine("spa,serial=123,register=R2");
+    writer.writeField("MainsCurrent", "1.2", 3);
+    writer.writeField("MainsVoltage", "240i", 4);
+    writer.finishLine();
+    writer.endFrame();
+
+    TEST_ASSERT_EQUAL(1, sink.packets.size());
+    TEST_ASSERT_EQUAL_STRING("spa,serial=123,register=R2 MainsCurrent=1.2,MainsVoltage=240i 1735689600000000000\n",
+        sink.packets[0].c_str());
+}
+
+void test_without_timestamp() {
+    PacketCollector sink;
+    InfluxLineWriter writer(sink);
+    writer.beginFrame("");
+    writer.startLine("spa,serial=123,register=R4");
+    writer.writeField("Mode", "\"NORM\"", 6);
+    writer.finishLine();
+    writer.endFrame();
+
+    TEST_ASSERT_EQUAL(1, sink.packets.size());
+    TEST_ASSERT_EQUAL_STRING("spa,serial=123,register=R4 Mode=\"NORM\"\n", sink.packets[0].c_str());
+}
+
+void test_empty_lines_are_not_written() {
+    PacketCollector sink;
+    InfluxLineWriter writer(sink);
+    writer.beginFrame(timestamp);
+    writer.startLine("spa,serial=123,register=R2");
+    writer.finishLine();
+    writer.endFrame();
+
+    TEST_ASSERT_EQUAL(0, sink.packets.size());
+}
+
+void test_lines_are_packed_into_packets() {
+    PacketCollector sink;
+    InfluxLineWriter writer(sink);
+    std::string expected;
+    writer.beginFrame(timestamp);
+    for (int i = 0; i < 100; i++) {
+        std::string series = "spa,serial=123,register=R" + std::to_string(i);
+        writer.startLine(series.c_str());
+        writer.writeField("Value", "12345i", 6);
+        writer.finishLine();
+        expected += series + " Value=12345i " + timestamp + "\n";
+    }
+    writer.endFrame();
+
+    TEST_ASSERT_GREATER_THAN(1, sink.packets.size());
+    for (const std::string &packet : sink.packets) {
+        TEST_ASSERT_LESS_OR_EQUAL(INFLUX_PACKET_SIZE, packet.size());
+        TEST_ASSERT_EQUAL('\n', packet.back());
+    }
+    // Every line is whole and in order
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), sink.joined().c_str());
+}
+
+void test_long_line_is_split() {
+    PacketCollector sink;
+    InfluxLineWriter writer(sink);
+    writer.beginFrame(timestamp);
+    writer.startLine("spa,serial=123,register=R5");
+    for (int i = 0; i < 200; i++) {
+        std::string name = "Field" + std::to_string(i);
+        writer.writeField(name.c_str(), "1.5", 3);
+    }
+    writer.finishLine();
+    writer.endFrame();
+
+    std::string all = sink.joined();
+    size_t lines = 0;
+    size_t fields = 0;
+    size_t start = 0;
+    while (start < all.size()) {
+        size_t end = all.find('\n', start);
+        TEST_ASSERT_TRUE(end != std::string::npos);
+        std::string line = all.substr(start, end - start);
+        TEST_ASSERT_LESS_OR_EQUAL(INFLUX_PACKET_SIZE - 1, line.size());
+        TEST_ASSERT_EQUAL(0, line.find("spa,serial=123,register=R5 Field"));
+        TEST_ASSERT_EQUAL(line.size() - strlen(timestamp) - 1, line.rfind(' '));
+        std::string fieldSet = line.substr(line.find(' ') + 1, line.rfind(' ') - line.find(' ') - 1);
+        for (char c : fieldSet) if (c == '=') fields++;
+        lines++;
+        start = end + 1;
+    }
+    TEST_ASSERT_GREATER_THAN(1, lines);
+    TEST_ASSERT_EQUAL(200, fields);
+    for (const std::string &packet : sink.packets) TEST_ASSERT_LESS_OR_EQUAL(INFLUX_PACKET_SIZE, packet.size());
+}
+
+void test_packet_filled_exactly() {
+    // Two lines that together are exactly one packet stay in one packet
+    PacketCollector sink;
+    InfluxLineWriter writer(sink);
+    writer.beginFrame("");
+    const char *series = "spa";
+    size_t valueLength = INFLUX_PACKET_SIZE / 2 - strlen("spa v=\n");
+    std::string value(valueLength, '1');
+    for (int i = 0; i < 3; i++) {
+        writer.startLine(series);
+        writer.writeField("v", value.c_str(), value.size());
+        writer.finishLine();
+    }
+    writer.endFrame();
+
+    TEST_ASSERT_EQUAL(2, sink.packets.size());
+    TEST_ASSERT_EQUAL(INFLUX_PACKET_SIZE, sink.packets[0].size());
+    TEST_ASSERT_EQUAL(INFLUX_PACKET_SIZE / 2, sink.packets[1].size());
+}
+
+void test_oversized_field_is_dropped() {
+    PacketCollector sink;
+    InfluxLineWriter writer(sink);
+    writer.beginFrame(timestamp);
+    std::string value(INFLUX_PACKET_SIZE, 'x');
+    writer.startLine("spa,serial=123,register=R6");
+    writer.writeField("Big", value.c_str(), value.size());
+    writer.writeField("Small", "1i", 2);
+    writer.finishLine();
+    writer.endFrame();
+
+    TEST_ASSERT_EQUAL(1, sink.packets.size());
+    TEST_ASSERT_EQUAL_STRING("spa,serial=123,register=R6 Small=1i 1735689600000000000\n", sink.packets[0].c_str());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_single_line);
+    RUN_TEST(test_without_timestamp);
+    RUN_TEST(test_empty_lines_are_not_written);
+    RUN_TEST(test_lines_are_packed_into_packets);
+    RUN_TEST(test_long_line_is_split);
+    RUN_TEST(test_packet_filled_exactly);
+    RUN_TEST(test_oversized_field_is_dropped);
+    return UNITY_END();
+}
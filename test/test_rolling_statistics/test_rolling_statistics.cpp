@@ -0,0 +1,103 @@
+#include <unity.h>
+#include <initializer_list>
+#include "RollingStatistics.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_empty() {
+    RollingStatistics stats;
+    TEST_ASSERT_EQUAL(0, stats.getCount());
+    TEST_ASSERT_EQUAL(0, stats.getMin());
+    TEST_ASSERT_EQUAL(0, stats.getMax());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0, stats.getMean());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0, stats.getEWMA());
+}
+
+void test_first_reading() {
+    RollingStatistics stats;
+    stats.add(385);
+    TEST_ASSERT_EQUAL(1, stats.getCount());
+    TEST_ASSERT_EQUAL(385, stats.getMin());
+    TEST_ASSERT_EQUAL(385, stats.getMax());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 385, stats.getMean());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 385, stats.getEWMA());
+}
+
+void test_window_limits() {
+    RollingStatistics stats;
+    stats.setWindow(1);
+    TEST_ASSERT_EQUAL(2, stats.getWindow());
+    stats.setWindow(200);
+    TEST_ASSERT_EQUAL(RollingStatistics::maxWindow, stats.getWindow());
+}
+
+void test_set_window_clears() {
+    RollingStatistics stats;
+    stats.add(1);
+    stats.add(2);
+    stats.setWindow(5);
+    TEST_ASSERT_EQUAL(0, stats.getCount());
+}
+
+void test_mean_over_window() {
+    RollingStatistics stats;
+    stats.setWindow(4);
+    for (int value : {10, 20, 30, 40, 50, 60}) stats.add(value);
+    // Only 30, 40, 50, 60 are left
+    TEST_ASSERT_EQUAL(4, stats.getCount());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 45, stats.getMean());
+    TEST_ASSERT_EQUAL(30, stats.getMin());
+    TEST_ASSERT_EQUAL(60, stats.getMax());
+}
+
+void test_min_max_rescanned_when_evicted() {
+    RollingStatistics stats;
+    stats.setWindow(3);
+    for (int value : {-5, 100, 7}) stats.add(value);
+    TEST_ASSERT_EQUAL(-5, stats.getMin());
+    TEST_ASSERT_EQUAL(100, stats.getMax());
+
+    stats.add(8);   // -5 drops out
+    TEST_ASSERT_EQUAL(7, stats.getMin());
+    TEST_ASSERT_EQUAL(100, stats.getMax());
+
+    stats.add(9);   // 100 drops out
+    TEST_ASSERT_EQUAL(7, stats.getMin());
+    TEST_ASSERT_EQUAL(9, stats.getMax());
+}
+
+void test_ewma() {
+    RollingStatistics stats;
+    stats.setWindow(3);  // alpha = 0.5
+    stats.add(0);
+    stats.add(100);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 50, stats.getEWMA());
+    stats.add(100);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 75, stats.getEWMA());
+}
+
+void test_clear() {
+    RollingStatistics stats;
+    stats.add(5);
+    stats.add(6);
+    stats.clear();
+    TEST_ASSERT_EQUAL(0, stats.getCount());
+    stats.add(-3);
+    TEST_ASSERT_EQUAL(-3, stats.getMin());
+    TEST_ASSERT_EQUAL(-3, stats.getMax());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, -3, stats.getEWMA());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_first_reading);
+    RUN_TEST(test_window_limits);
+    RUN_TEST(test_set_window_clears);
+    RUN_TEST(test_mean_over_window);
+    RUN_TEST(test_min_max_rescanned_when_evicted);
+    RUN_TEST(test_ewma);
+    RUN_TEST(test_clear);
+    return UNITY_END();
+}
@@ -0,0 +1,84 @@
+#include <unity.h>
+#include <string.h>
+#include "SpaCommand.h"
+
+void setUp() {}
+void tearDown() {}
+
+static SpaCommandName lookup(const char *name) {
+    return lookupSpaCommand(name, strlen(name));
+}
+
+static void assertCommand(SpaCommand command, uint8_t index, const char *name) {
+    SpaCommandName result = lookup(name);
+    TEST_ASSERT_EQUAL((int)command, (int)result.command);
+    TEST_ASSERT_EQUAL(index, result.index);
+}
+
+void test_every_command() {
+    assertCommand(SpaCommand::SetPoint, 0, "temperatures_setPoint");
+    assertCommand(SpaCommand::HeatPumpMode, 0, "heatpump_mode");
+    assertCommand(SpaCommand::HeatPumpAuxHeat, 0, "heatpump_auxheat");
+    assertCommand(SpaCommand::DateTime, 0, "status_datetime");
+    assertCommand(SpaCommand::SpaMode, 0, "status_spaMode");
+    assertCommand(SpaCommand::LightsState, 0, "lights_state");
+    assertCommand(SpaCommand::LightsEffect, 0, "lights_effect");
+    assertCommand(SpaCommand::LightsBrightness, 0, "lights_brightness");
+    assertCommand(SpaCommand::LightsColor, 0, "lights_color");
+    assertCommand(SpaCommand::LightsSpeed, 0, "lights_speed");
+    assertCommand(SpaCommand::BlowerState, 0, "blower_state");
+    assertCommand(SpaCommand::BlowerSpeed, 0, "blower_speed");
+    assertCommand(SpaCommand::BlowerMode, 0, "blower_mode");
+}
+
+void test_numbered_commands() {
+    assertCommand(SpaCommand::PumpSpeed, 1, "pump1_speed");
+    assertCommand(SpaCommand::PumpMode, 3, "pump3_mode");
+    assertCommand(SpaCommand::PumpState, 5, "pump5_state");
+    assertCommand(SpaCommand::SleepTimerState, 1, "sleepTimers_1_state");
+    assertCommand(SpaCommand::SleepTimerBegin, 2, "sleepTimers_2_begin");
+    assertCommand(SpaCommand::SleepTimerEnd, 2, "sleepTimers_2_end");
+    // The range is checked when the command is applied
+    assertCommand(SpaCommand::PumpState, 9, "pump9_state");
+}
+
+void test_unknown_names() {
+    assertCommand(SpaCommand::Unknown, 0, "");
+    assertCommand(SpaCommand::Unknown, 0, "lights");
+    assertCommand(SpaCommand::Unknown, 0, "lights_speedx");
+    assertCommand(SpaCommand::Unknown, 0, "Lights_speed");
+    assertCommand(SpaCommand::Unknown, 0, "pump#_speed");       // '#' is only a placeholder
+    assertCommand(SpaCommand::Unknown, 0, "pump12_speed");      // only the first digit is the number
+    assertCommand(SpaCommand::Unknown, 0, "pump_speed");
+    assertCommand(SpaCommand::Unknown, 0, "a_name_longer_than_the_pattern_buffer");
+}
+
+void test_hash_collision_is_rejected() {
+    // Same 32 bit FNV-1a hash as "lights_speed", the name must still be compared.
+    TEST_ASSERT_EQUAL(fnv1aConst("lights_speed"), fnv1aConst("llJq_E"));
+    assertCommand(SpaCommand::Unknown, 0, "llJq_E");
+}
+
+void test_length_is_respected() {
+    // The name is not NUL terminated where it ends, eg the last level of a topic in a buffer
+    SpaCommandName result = lookupSpaCommand("blower_modeXYZ", 11);
+    TEST_ASSERT_EQUAL((int)SpaCommand::BlowerMode, (int)result.command);
+}
+
+void test_const_hash() {
+    // FNV-1a test vectors
+    TEST_ASSERT_EQUAL(2166136261u, fnv1aConst(""));
+    TEST_ASSERT_EQUAL(0xe40c292cu, fnv1aConst("a"));
+    TEST_ASSERT_EQUAL(0xbf9cf968u, fnv1aConst("foobar"));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_every_command);
+    RUN_TEST(test_numbered_commands);
+    RUN_TEST(test_unknown_names);
+    RUN_TEST(test_hash_collision_is_rejected);
+    RUN_TEST(test_length_is_respected);
+    RUN_TEST(test_const_hash);
+    return UNITY_END();
+}
@@ -0,0 +1,160 @@
+#include <unity.h>
+#include <string.h>
+#include "SpaParse.h"
+
+void setUp() {}
+void tearDown() {}
+
+static StringView view(const char *s) {
+    return StringView{s, strlen(s)};
+}
+
+static void assertInt(int expected, const char *s) {
+    int value = -12345;
+    TEST_ASSERT_TRUE(parseInt(view(s), value));
+    TEST_ASSERT_EQUAL(expected, value);
+}
+
+static void assertIntRejected(const char *s) {
+    int value = -12345;
+    TEST_ASSERT_FALSE(parseInt(view(s), value));
+    TEST_ASSERT_EQUAL(-12345, value);
+}
+
+static void assertTimeOfDay(int expected, const char *s) {
+    int value = -1;
+    TEST_ASSERT_TRUE(parseTimeOfDay(view(s), value));
+    TEST_ASSERT_EQUAL(expected, value);
+}
+
+static void assertTimeOfDayRejected(const char *s) {
+    int value = -1;
+    TEST_ASSERT_FALSE(parseTimeOfDay(view(s), value));
+}
+
+static void assertDateTime(long long expected, const char *s) {
+    time_t value = 0;
+    TEST_ASSERT_TRUE(parseDateTime(view(s), value));
+    TEST_ASSERT_EQUAL(expected, (long long)value);
+}
+
+static void assertDateTimeRejected(const char *s) {
+    time_t value = 0;
+    TEST_ASSERT_FALSE(parseDateTime(view(s), value));
+}
+
+void test_string_view() {
+    StringView s = {"lights_speedXYZ", 12};
+    TEST_ASSERT_TRUE(s == "lights_speed");
+    TEST_ASSERT_TRUE(s != "lights_speedX");
+    TEST_ASSERT_TRUE(s != "lights");
+}
+
+void test_parse_int() {
+    assertInt(0, "0");
+    assertInt(42, "42");
+    assertInt(-42, "-42");
+    assertInt(7, "+7");
+    assertInt(7, "007");
+    assertInt(2147483647, "2147483647");
+    assertInt(-2147483647, "-2147483647");
+}
+
+void test_parse_int_rejected() {
+    assertIntRejected("");
+    assertIntRejected("-");
+    assertIntRejected("+");
+    assertIntRejected(" 1");
+    assertIntRejected("1 ");
+    assertIntRejected("3x");
+    assertIntRejected("1.5");
+    assertIntRejected("--1");
+    assertIntRejected("2147483648");
+    assertIntRejected("99999999999999999999");
+}
+
+void test_parse_int_not_terminated() {
+    int value = 0;
+    TEST_ASSERT_TRUE(parseInt(StringView{"123456", 3}, value));
+    TEST_ASSERT_EQUAL(123, value);
+}
+
+void test_parse_time_of_day() {
+    assertTimeOfDay(0, "00:00");
+    assertTimeOfDay(7 * 256 + 5, "7:05");
+    assertTimeOfDay(7 * 256 + 5, "07:5");
+    assertTimeOfDay(23 * 256 + 59, "23:59");
+}
+
+void test_parse_time_of_day_rejected() {
+    assertTimeOfDayRejected("");
+    assertTimeOfDayRejected("12");
+    assertTimeOfDayRejected(":30");
+    assertTimeOfDayRejected("12:");
+    assertTimeOfDayRejected("24:00");
+    assertTimeOfDayRejected("12:60");
+    assertTimeOfDayRejected("123:00");
+    assertTimeOfDayRejected("12:000");
+    assertTimeOfDayRejected("-1:30");
+    assertTimeOfDayRejected("12:+3");
+    assertTimeOfDayRejected("12:30:00");
+    assertTimeOfDayRejected("12:30 ");
+}
+
+void test_parse_date_time() {
+    assertDateTime(0, "1970-01-01 00:00:00");
+    assertDateTime(1735689600, "2025-01-01 00:00:00");
+    assertDateTime(1735689600 + 13 * 3600 + 14 * 60 + 15, "2025-01-01 13:14:15");
+    assertDateTime(1735689600 + 13 * 3600 + 14 * 60, "2025-01-01T13:14");
+    assertDateTime(951782400, "2000-02-29 00:00:00");        // leap year, divisible by 400
+    assertDateTime(1709164800, "2024-02-29 00:00");
+    assertDateTime(4291747199LL, "2105-12-31 23:59:59");
+}
+
+void test_parse_date_time_trailing_characters() {
+    assertDateTimeRejected("2025-01-01 00:00:00Z");
+    assertDateTimeRejected("2025-01-01 00:00:0");
+    assertDateTimeRejected("2025-01-01 00:00 ");
+    assertDateTimeRejected("2025-01-01 00:00:00.5");
+}
+
+void test_parse_date_time_out_of_range() {
+    assertDateTimeRejected("2025-00-01 00:00:00");
+    assertDateTimeRejected("2025-13-01 00:00:00");
+    assertDateTimeRejected("2025-01-00 00:00:00");
+    assertDateTimeRejected("2025-01-32 00:00:00");
+    assertDateTimeRejected("2025-04-31 00:00:00");
+    assertDateTimeRejected("2025-02-29 00:00:00");
+    assertDateTimeRejected("1900-02-29 00:00:00");
+    assertDateTimeRejected("2025-01-01 24:00:00");
+    assertDateTimeRejected("2025-01-01 00:60:00");
+    assertDateTimeRejected("2025-01-01 00:00:60");
+    assertDateTimeRejected("1969-12-31 23:59:59");
+    assertDateTimeRejected("2106-01-01 00:00:00");
+}
+
+void test_parse_date_time_malformed() {
+    assertDateTimeRejected("");
+    assertDateTimeRejected("2025-01-01");
+    assertDateTimeRejected("2025/01/01 00:00");
+    assertDateTimeRejected("2025-01-01_00:00");
+    assertDateTimeRejected("2025-01-01 00-00");
+    assertDateTimeRejected("2025-01-01 00:00-00");
+    assertDateTimeRejected("2025-+1-01 00:00");
+    assertDateTimeRejected("20x5-01-01 00:00");
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_string_view);
+    RUN_TEST(test_parse_int);
+    RUN_TEST(test_parse_int_rejected);
+    RUN_TEST(test_parse_int_not_terminated);
+    RUN_TEST(test_parse_time_of_day);
+    RUN_TEST(test_parse_time_of_day_rejected);
+    RUN_TEST(test_parse_date_time);
+    RUN_TEST(test_parse_date_time_trailing_characters);
+    RUN_TEST(test_parse_date_time_out_of_range);
+    RUN_TEST(test_parse_date_time_malformed);
+    return UNITY_END();
+}
@@ -0,0 +1,91 @@
+#include <unity.h>
+#include <string>
+#include <ArduinoJson.h>
+#include "StatusDelta.h"
+
+void setUp() {}
+void tearDown() {}
+
+static bool delta(const char *previousJson, const char *currentJson, JsonDocument &result) {
+    JsonDocument previous, current;
+    deserializeJson(previous, previousJson);
+    deserializeJson(current, currentJson);
+    return generateStatusDelta(previous.as<JsonVariantConst>(), current.as<JsonVariantConst>(), result.to<JsonObject>());
+}
+
+static void assertJson(const char *expected, const JsonDocument &doc) {
+    std::string output;
+    serializeJson(doc, output);
+    TEST_ASSERT_EQUAL_STRING(expected, output.c_str());
+}
+
+void test_empty_documents() {
+    JsonDocument result;
+    TEST_ASSERT_FALSE(delta("{}", "{}", result));
+    assertJson("{}", result);
+}
+
+void test_unchanged_document() {
+    const char *status = "{\"temperatures\":{\"water\":38.5,\"setPoint\":38},\"status\":{\"spaMode\":\"NORM\"}}";
+    JsonDocument result;
+    TEST_ASSERT_FALSE(delta(status, status, result));
+    // The nested objects are not left behind empty
+    assertJson("{}", result);
+}
+
+void test_first_document_is_whole() {
+    JsonDocument result;
+    TEST_ASSERT_TRUE(delta("{}", "{\"a\":1,\"b\":{\"c\":\"x\"}}", result));
+    assertJson("{\"a\":1,\"b\":{\"c\":\"x\"}}", result);
+}
+
+void test_changed_leaves_only() {
+    JsonDocument result;
+    TEST_ASSERT_TRUE(delta(
+        "{\"temperatures\":{\"water\":38.5,\"setPoint\":38},\"lights\":{\"state\":\"OFF\"}}",
+        "{\"temperatures\":{\"water\":38.6,\"setPoint\":38},\"lights\":{\"state\":\"OFF\"}}",
+        result));
+    assertJson("{\"temperatures\":{\"water\":38.6}}", result);
+}
+
+void test_type_change() {
+    JsonDocument result;
+    TEST_ASSERT_TRUE(delta("{\"a\":{\"b\":1},\"c\":2}", "{\"a\":3,\"c\":{\"d\":4}}", result));
+    assertJson("{\"a\":3,\"c\":{\"d\":4}}", result);
+}
+
+void test_removed_members_are_null() {
+    JsonDocument result;
+    TEST_ASSERT_TRUE(delta("{\"a\":1,\"b\":{\"c\":2,\"d\":3}}", "{\"b\":{\"c\":2}}", result));
+    assertJson("{\"b\":{\"d\":null},\"a\":null}", result);
+}
+
+void test_merge_keeps_nulls() {
+    JsonDocument pending, first, second;
+    deserializeJson(first, "{\"a\":1,\"b\":{\"c\":2}}");
+    deserializeJson(second, "{\"a\":null,\"b\":{\"d\":3}}");
+    mergeStatusDelta(pending.to<JsonObject>(), first.as<JsonObjectConst>());
+    mergeStatusDelta(pending.as<JsonObject>(), second.as<JsonObjectConst>());
+    assertJson("{\"a\":null,\"b\":{\"c\":2,\"d\":3}}", pending);
+}
+
+void test_merge_replaces_leaf_with_object() {
+    JsonDocument pending, update;
+    deserializeJson(pending, "{\"a\":1}");
+    deserializeJson(update, "{\"a\":{\"b\":2}}");
+    mergeStatusDelta(pending.as<JsonObject>(), update.as<JsonObjectConst>());
+    assertJson("{\"a\":{\"b\":2}}", pending);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_documents);
+    RUN_TEST(test_unchanged_document);
+    RUN_TEST(test_first_document_is_whole);
+    RUN_TEST(test_changed_leaves_only);
+    RUN_TEST(test_type_change);
+    RUN_TEST(test_removed_members_are_null);
+    RUN_TEST(test_merge_keeps_nulls);
+    RUN_TEST(test_merge_replaces_leaf_with_object);
+    return UNITY_END();
+}